@@ -1,12 +1,20 @@
+#define _GNU_SOURCE /* pipe2 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
 #include <libgen.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <sys/stat.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 #include <alsa/asoundlib.h>
 #include <mpd/client.h>
 
@@ -44,10 +52,45 @@
 #define BAT_BAD      1
 
 #define batcmp(x,y) memcmp(x, y, strlen(y))
-
-#define SLEEP_INTERVAL  1000 /* ms */
+#define LENGTH(x)   (sizeof(x)/sizeof(*x))
+
+#define PANDORA         0    /* show the battery */
+
+/* seconds between refreshes of each segment, the pager, volume
+ * and mpd are refreshed when they change, and mpd every second
+ * while playing, to show the elapsed time */
+#define MPD_INTERVAL    1
+#define MPD_BACKOFF     64   /* the longest wait between reconnects to mpd */
+#define BAT_INTERVAL    60
+#define DATE_INTERVAL   60   /* on the minute */
+#define UPDATE_INTERVAL 3600 /* pacman and cower, their counts are kept until then */
 #define MPD_TIMEOUT     3000
 
+#define PAGER_BUFFER    4096 /* power of two, longer lines are dropped */
+
+enum { SEG_PAGER, SEG_MPD, SEG_COWER, SEG_PACMAN, SEG_VOLUME, SEG_BATTERY, SEG_DATE, SEG_LAST };
+
+/* the rendered text of a part of the bar */
+typedef struct segment_t {
+   char text[512];
+   size_t len;
+} segment_t;
+
+enum { SRC_FILE, SRC_TIMER, SRC_PROBE };
+
+/* something to wait on, a timer or a file, that refreshes a segment */
+typedef struct source_t {
+   int fd, segment, type;
+} source_t;
+
+/* a command run in the background, whose output lines are counted
+ * and kept for its segment until the command is run again */
+typedef struct probe_t {
+   const char *argv[3];
+   source_t src;
+   int count, lines;
+} probe_t;
+
 typedef struct desktop_t {
    int current, urgent, windows;
    const char *n;
@@ -67,11 +110,17 @@ static desktop_t desktop[] = {
    { .n = NULL }
 };
 
+/* indexed by the mode ids monsterwm outputs, in the order of the
+ * modes enum of its config.h */
 static layout_t layout[]  = {
    { .n = "CLASSIC", .c = LAYOUT },
    { .n = "MONOCLE", .c = LAYOUT },
    { .n = "BACKSTAB", .c = LAYOUT },
    { .n = "GRID", .c = LAYOUT },
+   { .n = "SPIRAL", .c = LAYOUT },
+   { .n = "CENTER", .c = LAYOUT },
+   { .n = "DECK", .c = LAYOUT },
+   { .n = "COLUMNS", .c = LAYOUT },
    { .n = "TROLL", .c = LAYOUT },
    { .n =  NULL }
 };
@@ -91,123 +140,104 @@ typedef struct mpdstate {
    unsigned int crossfade;
    unsigned int playmode;
    unsigned int duration;
-   unsigned int elapsed;
+   unsigned int elapsed; /* ms, when the status was read */
    int volume;
    int song;
    enum mpd_state state;
 } mpdstate;
 
-/* mpd client definition */
+/* mpd client definition, the connection is kept
+ * open and waits for changes with the idle command */
 typedef struct mpdclient {
    mpdstate state;
    struct mpd_connection *connection;
-   struct mpd_status *status;
+   struct timespec stamp; /* when the status was read */
+   source_t src;
+   int timer, backoff, hassong;
+   char artist[128], album[128], title[128];
 } mpdclient;
 static mpdclient *mpd = NULL;
 
+static segment_t segment[SEG_LAST];
+static source_t source[16];
+static int nsources = 0;
+static snd_mixer_elem_t *mixer;
+static int mode = 0, layouts = 0;
+
+/* the bytes read from the fifo, kept from head up to tail
+ * and indexed modulo the buffer size, line is where the
+ * newest line starts, skip drops a line that did not fit */
+static char pagerbuf[PAGER_BUFFER];
+static size_t pagerhead = 0, pagerline = 0, pagertail = 0;
+static int pagerskip = 0;
+
+static probe_t probe[SEG_LAST] = {
+   [SEG_PACMAN] = { .argv = { "pacup", "-u", NULL }, .src = { .fd = -1 }, .count = -1 },
+   [SEG_COWER]  = { .argv = { "cower", "-u", NULL }, .src = { .fd = -1 }, .count = -1 },
+};
+
 static void die(const char *errstr, ...) {
    va_list ap;
    va_start(ap, errstr); vfprintf(stderr, errstr, ap); va_end(ap);
    exit(EXIT_FAILURE);
 }
 
-static int execget(char *bin, char *buffer, size_t len) {
-   FILE *p;
-   size_t read;
-
-   memset(buffer, 0, len);
-   if (!(p = popen(bin, "r")))
-      return 0;
+static void segprintf(segment_t *s, const char *fmt, ...) {
+   va_list ap;
+   int n;
 
-   read = fread(buffer, 1, len-1, p);
-   fclose(p);
+   va_start(ap, fmt);
+   n = vsnprintf(s->text + s->len, sizeof(s->text) - s->len, fmt, ap);
+   va_end(ap);
 
-   if (read && buffer[read-1] == '\n')
-      buffer[read-1] = 0;
-   return read;
+   if (n > 0) s->len = s->len + n < sizeof(s->text) ? s->len + n : sizeof(s->text) - 1;
 }
 
-static int strsplit(char ***dst, char *str, char *token) {
-   char *saveptr, *ptr, *start;
-   int32_t t_len, i;
-
-   if (!(saveptr=strdup(str)))
-      return 0;
-
-   *dst=NULL;
-   t_len=strlen(token);
-   i=0;
-
-   for (start=saveptr,ptr=start;;ptr++) {
-      if (!strncmp(ptr,token,t_len) || !*ptr) {
-         while (!strncmp(ptr,token,t_len)) {
-            *ptr=0;
-            ptr+=t_len;
-         }
-
-         if (!((*dst)=realloc(*dst,(i+2)*sizeof(char*))))
-            return 0;
-         (*dst)[i]=start;
-         (*dst)[i+1]=NULL;
-         i++;
+static void watchsource(int efd, source_t *src) {
+   struct epoll_event ev;
 
-         if (!*ptr)
-            break;
-         start=ptr;
-      }
-   }
-   return i;
-}
-
-static void strsplit_clear(char ***dst) {
-   if ((*dst)[0]) free((*dst)[0]);
-   free((*dst));
+   ev.events = EPOLLIN;
+   ev.data.ptr = src;
+   if (epoll_ctl(efd, EPOLL_CTL_ADD, src->fd, &ev) == -1)
+      die("could not watch fd %d\n", src->fd);
 }
 
 static void mpd_quit(void) {
    if (!mpd)
       return;
 
-   if (mpd->status)     mpd_status_free(mpd->status);
    if (mpd->connection) mpd_connection_free(mpd->connection);
    free(mpd);
 }
 
-static int mpd_init(void) {
-   if (mpd && mpd_connection_get_error(mpd->connection) == MPD_ERROR_SUCCESS)
-      return 1;
-
-   unsigned int mpd_port = 6600;
-   const char *host = getenv("MPD_HOST");
-   const char *port = getenv("MPD_PORT");
-   const char *pass = getenv("MPD_PASSWORD");
-
-   if (!host)  host     = "localhost";
-   if (port)   mpd_port = strtol(port, (char**) NULL, 10);
+/* arm the mpd timer to first fire in first ms and then every interval ms,
+ * a first of 0 disarms it */
+static void mpd_timer(int first, int interval) {
+   struct itimerspec its;
 
-   mpd_quit();
-
-   if (!(mpd = calloc(1, sizeof(mpdclient))))
-      die("mpdclient allocation failed");
-
-   if (!(mpd->connection = mpd_connection_new(host, mpd_port, MPD_TIMEOUT)) ||
-         mpd_connection_get_error(mpd->connection))
-      return 0;
+   its.it_value.tv_sec = first / 1000;
+   its.it_value.tv_nsec = (first % 1000) * 1000000L;
+   its.it_interval.tv_sec = interval / 1000;
+   its.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+   timerfd_settime(mpd->timer, 0, &its, NULL);
+}
 
-   if (pass && !mpd_run_password(mpd->connection, pass))
-      return 0;
+/* drop the connection, and reconnect after waiting
+ * twice as long as the last time, up to MPD_BACKOFF */
+static void mpd_disconnect(void) {
+   if (mpd->connection) mpd_connection_free(mpd->connection);
+   mpd->connection = NULL;
+   mpd->hassong = 0;
 
-   return (mpd_connection_get_error(mpd->connection) == MPD_ERROR_SUCCESS);
+   mpd_timer(mpd->backoff * 1000, 0);
+   mpd->backoff = mpd->backoff * 2 < MPD_BACKOFF ? mpd->backoff * 2 : MPD_BACKOFF;
 }
 
-static void mpd_now_playing(void) {
-   char *basec = NULL, *based = NULL;
+/* cache the tags of the current song */
+static void mpd_update_song(void) {
+   char buffer[512];
    struct mpd_song *song = mpd_run_current_song(mpd->connection);
-   if (!song) return;
-   const char *disc    = mpd_song_get_tag(song, MPD_TAG_DISC, 0);
-   const char *track   = mpd_song_get_tag(song, MPD_TAG_TRACK, 0);
-   const char *comment = mpd_song_get_tag(song, MPD_TAG_COMMENT, 0);
-   const char *genre   = mpd_song_get_tag(song, MPD_TAG_GENRE, 0);
+   if (!(mpd->hassong = (song != NULL))) return;
    const char *album   = mpd_song_get_tag(song, MPD_TAG_ALBUM, 0);
    const char *title   = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
    const char *artist  = mpd_song_get_tag(song, MPD_TAG_ARTIST, 0);
@@ -215,57 +245,92 @@ static void mpd_now_playing(void) {
    if (!artist) artist = mpd_song_get_tag(song, MPD_TAG_ALBUM_ARTIST, 0);
    if (!artist) artist = mpd_song_get_tag(song, MPD_TAG_COMPOSER, 0);
    if (!artist) artist = mpd_song_get_tag(song, MPD_TAG_PERFORMER, 0);
-   if (!album && (based = strdup(mpd_song_get_uri(song)))) album = basename(dirname(based));
-   if (!title && (basec = strdup(mpd_song_get_uri(song)))) title = basename(basec);
 
    /* fallbacks */
-   if (!artist) artist = "noartist";
-   if (!album)  album  = "noalbum";
-   if (!title)  title  = "notitle";
-
-   int em, es, dm, ds;
-   em = mpd->state.elapsed / 60;
-   es = mpd->state.elapsed - em * 60;
-   dm = mpd->state.duration / 60;
-   ds = mpd->state.duration - dm * 60;
-
-   if (artist && album && title)  {
-      printf(MPD_TIME" "MPD_SEP" "
-             "\\f%d%s "MPD_SEP" \\f%d%s "MPD_SEP" \\f%d%s\\f1", em, es, dm, ds,
-            MPD_ARTIST_FG, artist, MPD_ALBUM_FG, album, MPD_TITLE_FG, title);
-   }
+   snprintf(mpd->artist, sizeof(mpd->artist), "%s", artist ? artist : "noartist");
+   snprintf(buffer, sizeof(buffer), "%s", mpd_song_get_uri(song));
+   snprintf(mpd->album, sizeof(mpd->album), "%s", album ? album : basename(dirname(buffer)));
+   snprintf(buffer, sizeof(buffer), "%s", mpd_song_get_uri(song));
+   snprintf(mpd->title, sizeof(mpd->title), "%s", title ? title : basename(buffer));
    mpd_song_free(song);
-   free(based);
-   free(basec);
 }
 
 static int mpd_update_status(void) {
-   if (mpd->status) mpd_status_free(mpd->status);
-   if (!(mpd->status = mpd_run_status(mpd->connection)))
+   struct mpd_status *status;
+   if (!(status = mpd_run_status(mpd->connection)))
       return -1;
 
-   mpd->state.id        = mpd_status_get_update_id(mpd->status);
-   mpd->state.volume    = mpd_status_get_volume(mpd->status);
-   mpd->state.crossfade = mpd_status_get_crossfade(mpd->status);
-   mpd->state.queuever  = mpd_status_get_queue_version(mpd->status);
-   mpd->state.queuelen  = mpd_status_get_queue_length(mpd->status);
-   mpd->state.song      = mpd_status_get_song_id(mpd->status);
-   mpd->state.elapsed   = mpd_status_get_elapsed_time(mpd->status);
-   mpd->state.duration  = mpd_status_get_total_time(mpd->status);
-   mpd->state.state     = mpd_status_get_state(mpd->status);
-
-   if (mpd_status_get_repeat(mpd->status))
+   mpd->state.id        = mpd_status_get_update_id(status);
+   mpd->state.volume    = mpd_status_get_volume(status);
+   mpd->state.crossfade = mpd_status_get_crossfade(status);
+   mpd->state.queuever  = mpd_status_get_queue_version(status);
+   mpd->state.queuelen  = mpd_status_get_queue_length(status);
+   mpd->state.song      = mpd_status_get_song_id(status);
+   mpd->state.elapsed   = mpd_status_get_elapsed_ms(status);
+   mpd->state.duration  = mpd_status_get_total_time(status);
+   mpd->state.state     = mpd_status_get_state(status);
+   clock_gettime(CLOCK_MONOTONIC, &mpd->stamp);
+
+   mpd->state.playmode = 0;
+   if (mpd_status_get_repeat(status))
       mpd->state.playmode |= PLAY_REPEAT;
-   if (mpd_status_get_random(mpd->status))
+   if (mpd_status_get_random(status))
       mpd->state.playmode |= PLAY_RANDOM;
-   if (mpd_status_get_single(mpd->status))
+   if (mpd_status_get_single(status))
       mpd->state.playmode |= PLAY_SINGLE;
-   if (mpd_status_get_consume(mpd->status))
+   if (mpd_status_get_consume(status))
       mpd->state.playmode |= PLAY_CONSUME;
+   mpd_status_free(status);
+
+   /* tick on the seconds of the song while it plays */
+   if (mpd->state.state == MPD_STATE_PLAY)
+      mpd_timer(1000 - mpd->state.elapsed % 1000, 1000);
+   else mpd_timer(0, 0);
 
    return mpd->state.song;
 }
 
+static int mpd_idle(void) {
+   return mpd_send_idle_mask(mpd->connection, MPD_IDLE_PLAYER|MPD_IDLE_MIXER|MPD_IDLE_OPTIONS);
+}
+
+static void mpd_connect(int efd) {
+   unsigned int mpd_port = 6600;
+   const char *host = getenv("MPD_HOST");
+   const char *port = getenv("MPD_PORT");
+   const char *pass = getenv("MPD_PASSWORD");
+
+   if (!host)  host     = "localhost";
+   if (port)   mpd_port = strtol(port, (char**) NULL, 10);
+
+   if (!(mpd->connection = mpd_connection_new(host, mpd_port, MPD_TIMEOUT)) ||
+         mpd_connection_get_error(mpd->connection) != MPD_ERROR_SUCCESS ||
+         (pass && !mpd_run_password(mpd->connection, pass)) ||
+         mpd_update_status() == -1) {
+      mpd_disconnect();
+      return;
+   }
+   mpd_update_song();
+
+   mpd->src = (source_t){ .fd = mpd_connection_get_fd(mpd->connection), .segment = SEG_MPD, .type = SRC_FILE };
+   watchsource(efd, &mpd->src);
+   if (!mpd_idle()) mpd_disconnect();
+   else mpd->backoff = 1;
+}
+
+/* mpd reported changes, read them again and wait for the next ones */
+static void mpd_changed(void) {
+   enum mpd_idle idle = mpd_recv_idle(mpd->connection, false);
+
+   if (mpd_connection_get_error(mpd->connection) != MPD_ERROR_SUCCESS ||
+         (idle && mpd_update_status() == -1)) {
+      mpd_disconnect();
+      return;
+   }
+   if (idle & MPD_IDLE_PLAYER) mpd_update_song();
+   if (!mpd_idle()) mpd_disconnect();
+}
+
 static snd_mixer_t* alsainit(const char *card)
 {
    snd_mixer_t *handle;
@@ -319,166 +384,337 @@ static int batterycharge(int *charge)
    return 1;
 }
 
-static int printmpd() {
-   if (mpd_init() && mpd_update_status() != -1) {
-      mpd_now_playing();
-      return 1;
-   }
-   return 0;
-}
+static void printmpd(segment_t *s) {
+   struct timespec now;
+   unsigned int elapsed;
+   int em, es, dm, ds;
 
-static void printpacman(int update) {
-   static char buffer[5];
-   static int times = 1;
+   if (!mpd->connection || !mpd->hassong)
+      return;
 
-   if (!update && --times==0) {
-      execget("pacup -u 2>/dev/null | wc -l", buffer, 5);
-      times = 60 * 60;
+   /* the elapsed time is counted from when the status was read */
+   elapsed = mpd->state.elapsed;
+   if (mpd->state.state == MPD_STATE_PLAY) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      elapsed += (now.tv_sec - mpd->stamp.tv_sec) * 1000 + (now.tv_nsec - mpd->stamp.tv_nsec) / 1000000;
    }
+   elapsed /= 1000;
+   if (mpd->state.duration && elapsed > mpd->state.duration)
+      elapsed = mpd->state.duration;
 
-   printf("\\f%d%s\\f1", UPDATE_FG, buffer);
-}
+   em = elapsed / 60;
+   es = elapsed - em * 60;
+   dm = mpd->state.duration / 60;
+   ds = mpd->state.duration - dm * 60;
 
-static void printcower(int update) {
-   static char buffer[5];
-   static int times = 1;
+   segprintf(s, MPD_TIME" "MPD_SEP" "
+          "\\f%d%s "MPD_SEP" \\f%d%s "MPD_SEP" \\f%d%s\\f1", em, es, dm, ds,
+         MPD_ARTIST_FG, mpd->artist, MPD_ALBUM_FG, mpd->album, MPD_TITLE_FG, mpd->title);
+}
 
-   if (!update && --times==0) {
-      execget("cower -u 2>/dev/null | wc -l", buffer, 5);
-      times = 60 * 60;
-   }
+static void printpacman(segment_t *s) {
+   if (probe[SEG_PACMAN].count >= 0)
+      segprintf(s, "\\f%d%d\\f1", UPDATE_FG, probe[SEG_PACMAN].count);
+   else segprintf(s, "\\f%d\\f1", UPDATE_FG);
+}
 
-   printf("\\f%d%s\\f1", COWER_FG, buffer);
+static void printcower(segment_t *s) {
+   if (probe[SEG_COWER].count >= 0)
+      segprintf(s, "\\f%d%d\\f1", COWER_FG, probe[SEG_COWER].count);
+   else segprintf(s, "\\f%d\\f1", COWER_FG);
 }
 
-static void printvolume(snd_mixer_elem_t *mixer) {
-   printf("\\f%d%3d%%\\f1", VOL_FG, getvolume(mixer));
+static void printvolume(segment_t *s) {
+   segprintf(s, "\\f%d%3d%%\\f1", VOL_FG, getvolume(mixer));
 }
 
-static void printbattery() {
+static void printbattery(segment_t *s) {
    char state[13]; int charge, color;
    if (!batterystate(state) || !batterycharge(&charge)) {
-      printf("FAIL");
+      segprintf(s, "FAIL");
       return;
    }
    if (!batcmp(state, "Charging"))  color = BAT_CHARGING;
    else if (charge > 65)            color = BAT_GOOD;
    else if (charge > 25)            color = BAT_AVEG;
    else                             color = BAT_BAD;
-   printf("\\f%d%s %3d%%", color, !batcmp(state, "Charging")?"CHR":"BAT", charge);
+   segprintf(s, "\\f%d%s %3d%%", color, !batcmp(state, "Charging")?"CHR":"BAT", charge);
 }
 
-static void printdate() {
+static void printdate(segment_t *s) {
    char date[12], clock[8];
    time_t rawtime; struct tm *timeinfo;
    time(&rawtime);
    timeinfo = localtime(&rawtime);
    strftime(date, sizeof(date)-1, "%a %d/%m", timeinfo);
    strftime(clock, sizeof(clock)-1, "%H:%M", timeinfo);
-   printf("\\f%d%s "DATE_SEP" \\f%d%s\\f1", DATE_FG, date, TIME_FG, clock);
+   segprintf(s, "\\f%d%s "DATE_SEP" \\f%d%s\\f1", DATE_FG, date, TIME_FG, clock);
 }
 
-static void printdata()
+static void printdata(segment_t *s)
 {
    int i;
-   char color;
 
    for (i = 0; desktop[i].n; ++i) {
-      color = desktop[i].c;
       if (desktop[i].current)
-        printf("\\f9\\u9\\b0 ");
+        segprintf(s, "\\f9\\u9\\b0 ");
       else if (desktop[i].urgent)
-        printf("\\f9\\u3\\b0 ");
-      else printf("\\f9\\u0\\b0 ");
+        segprintf(s, "\\f9\\u3\\b0 ");
+      else segprintf(s, "\\f9\\u0\\b0 ");
 
-      printf("%s", desktop[i].n);
-      printf(" \\u0\\b0");
+      segprintf(s, "%s", desktop[i].n);
+      segprintf(s, " \\u0\\b0");
    }
 }
 
-static void printlayout(int mode)
+static void printlayout(segment_t *s)
 {
-   printf("\\f%d%s MODE\\f1", LAYOUT, layout[mode].n);
+   segprintf(s, "\\f%d%s MODE\\f1", LAYOUT, layout[mode<layouts?mode:0].n);
 }
 
-static void monsterpager(const char *fifo, int fd, int monitor, int desks, int *mode)
+static void printpager(segment_t *s)
 {
-   size_t bytes = 0;
-   int tags = 0, i = 0, co = 0;
-   int mon = 0, amon = 0, d = 0, w = 0, m = 0, c = 0, u = 0;
-   char buffer[256], **data = NULL;
-
-   memset(buffer, 0, sizeof(buffer));
-   while ((bytes = read(fd, buffer, sizeof(buffer)-1)) >= 0)
-   {
-      /* check if eof */
-      if (!bytes) {
-         close(fd);
-         if ((fd = open(fifo, O_RDONLY)) == -1)
-            die("could not reopen fifo\n");
-         break;
-      }
+   printdata(s);
+   segprintf(s, "\\f2| ");
+   printlayout(s);
+}
 
-      /* not right kind of data */
-      if (buffer[1] != ':' || buffer[3] != ':' ||
-          buffer[5] != ':' || buffer[7] != ':') {
-         memset(buffer, 0, bytes);
-         printdata();
-         break;
+static void (*render[SEG_LAST])(segment_t *s) = {
+   [SEG_PAGER]   = printpager,
+   [SEG_MPD]     = printmpd,
+   [SEG_COWER]   = printcower,
+   [SEG_PACMAN]  = printpacman,
+   [SEG_VOLUME]  = printvolume,
+   [SEG_BATTERY] = printbattery,
+   [SEG_DATE]    = printdate,
+};
+
+/* render a segment again, returns whether its text changed */
+static int refresh(int seg) {
+   segment_t s;
+   s.len = 0; s.text[0] = 0;
+   render[seg](&s);
+   if (!strcmp(s.text, segment[seg].text))
+      return 0;
+   segment[seg] = s;
+   return 1;
+}
+
+static void draw(void) {
+   /* left */
+   alignleft();
+   printf(" %s", segment[SEG_PAGER].text);
+
+   /* center */
+   aligncenter();
+
+   /* right */
+   alignright();
+   if (segment[SEG_MPD].len) {
+      printf("%s", segment[SEG_MPD].text);
+      whitespace();
+   }
+   printf("%s", segment[SEG_COWER].text);
+   whitespace();
+   printf("%s", segment[SEG_PACMAN].text);
+   whitespace();
+   printf("%s", segment[SEG_VOLUME].text);
+#if PANDORA
+   whitespace();
+   printf("%s", segment[SEG_BATTERY].text);
+#endif
+   whitespace();
+   printf("%s", segment[SEG_DATE].text);
+   printf(" ");
+   eol();
+   fflush(stdout);
+}
+
+static void watch(int efd, int fd, int seg, int type) {
+   if (nsources == LENGTH(source))
+      die("too many sources\n");
+   source[nsources] = (source_t){ .fd = fd, .segment = seg, .type = type };
+   watchsource(efd, &source[nsources++]);
+}
+
+/* run the probe's command with its output on a pipe
+ * watched by the main loop, unless it is still running */
+static void probestart(int efd, probe_t *p) {
+   int fds[2], null;
+
+   if (p->src.fd != -1 || pipe2(fds, O_CLOEXEC) == -1)
+      return;
+
+   switch (fork()) {
+      case -1:
+         close(fds[0]); close(fds[1]);
+         return;
+      case 0:
+         /* the command only keeps its stdout and stderr */
+         dup2(fds[1], STDOUT_FILENO);
+         close(fds[0]);
+         if (fds[1] != STDOUT_FILENO)
+            close(fds[1]);
+         if ((null = open("/dev/null", O_WRONLY)) != -1) {
+            dup2(null, STDERR_FILENO);
+            if (null != STDERR_FILENO)
+               close(null);
+         }
+         signal(SIGCHLD, SIG_DFL);
+         execvp(p->argv[0], (char **)p->argv);
+         _exit(127);
+   }
+
+   close(fds[1]);
+   fcntl(fds[0], F_SETFL, O_NONBLOCK);
+   p->lines = 0;
+   p->src.fd = fds[0];
+   watchsource(efd, &p->src);
+}
+
+/* count the lines the probe's command printed,
+ * and keep the count once the command is done */
+static void proberead(int efd, probe_t *p) {
+   char buffer[4096];
+   ssize_t bytes, i;
+
+   while ((bytes = read(p->src.fd, buffer, sizeof(buffer))) > 0)
+      for (i = 0; i != bytes; ++i)
+         if (buffer[i] == '\n') ++p->lines;
+
+   if (bytes == -1 && (errno == EAGAIN || errno == EINTR))
+      return;
+
+   epoll_ctl(efd, EPOLL_CTL_DEL, p->src.fd, NULL);
+   close(p->src.fd);
+   p->src.fd = -1;
+   p->count = p->lines;
+}
+
+/* refresh a segment every interval seconds, on the multiple
+ * of the interval of the wall clock when aligned, returns the timer */
+static int every(int efd, int seg, int interval, int aligned) {
+   int fd, clock = aligned ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+   struct itimerspec its;
+
+   memset(&its, 0, sizeof(its));
+   its.it_interval.tv_sec = interval;
+   clock_gettime(clock, &its.it_value);
+   if (aligned) {
+      its.it_value.tv_sec += interval - its.it_value.tv_sec % interval;
+      its.it_value.tv_nsec = 0;
+   } else its.it_value.tv_sec += interval;
+
+   if ((fd = timerfd_create(clock, TFD_NONBLOCK|TFD_CLOEXEC)) == -1 ||
+         timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+      die("could not create timer\n");
+   watch(efd, fd, seg, SRC_TIMER);
+   return fd;
+}
+
+/* parse a line of m:cm:d:w:mode:cur:urg entries from the fifo buffer */
+static void pagerparse(size_t start, size_t end, int monitor, int desks)
+{
+   int field[7], f = 0, v = 0, ok = 1;
+   size_t i;
+   char ch;
+
+   for (i = start; i <= end; ++i) {
+      ch = i < end ? pagerbuf[i & (PAGER_BUFFER-1)] : ' ';
+      if (ch >= '0' && ch <= '9') {
+         /* a number too long for an int is no valid value, and would
+          * wrap around to one, or to a negative desktop index */
+         if (v > (INT_MAX - 9) / 10) ok = 0;
+         else v = v * 10 + ch - '0';
       }
+      else if (ch == ':' && f < 6) {
+         field[f++] = v;
+         v = 0;
+      } else if (ch == ' ') {
+         field[6] = v;
+         if (ok && f == 6 && field[0] == monitor && field[2] < desks) {
+            /* desktop flags */
+            desktop[field[2]].windows = field[3];
+            desktop[field[2]].current = field[5] ? 1 : 0;
+            desktop[field[2]].urgent  = field[6] ? 1 : 0;
+            if (field[5]) mode = field[4];
+         }
+         f = v = 0; ok = 1;
+      } else ok = 0;
+   }
+}
+
+/* read all there is on the fifo, and parse only the newest whole line,
+ * as each line holds the state of every desktop */
+static void monsterpager(int fd, int monitor, int desks)
+{
+   size_t i, pos, room, end = 0;
+   ssize_t bytes;
+   int found = 0;
 
-      /* strsplit */
-      tags = strsplit(&data, buffer, " ");
-      for(i = 0; i != tags; ++i) {
-         /* sscanf data */
-         co = sscanf(data[i], "%d:%d:%d:%d:%d:%d:%d",
-               &mon, &amon, &d, &w, &m, &c, &u);
-         if (mon != monitor) continue;
-         if (co < 7)      break;
-         if (d  >= desks) break;
-
-         /* desktop flags */
-         if (u) desktop[d].urgent = 1;
-         else   desktop[d].urgent = 0;
-         if (c) {
-            desktop[d].current = 1;
-            *mode = m;
-         } else   desktop[d].current = 0;
-         desktop[d].windows = w;
+   while (1) {
+      if (pagertail - pagerhead == PAGER_BUFFER) {
+         /* full, parse the newest line to make room, or drop the partial line */
+         if (found) pagerparse(pagerhead, end, monitor, desks);
+         else pagerskip = 1, pagerline = pagertail;
+         pagerhead = pagerline;
+         found = 0;
       }
 
-      printdata();
-      strsplit_clear(&data);
-      break;
+      /* read up to the end of the free space or of the buffer */
+      pos  = pagertail & (PAGER_BUFFER-1);
+      room = PAGER_BUFFER - (pagertail - pagerhead);
+      if (room > PAGER_BUFFER - pos) room = PAGER_BUFFER - pos;
+      if ((bytes = read(fd, pagerbuf + pos, room)) <= 0)
+         break;
+
+      for (i = pagertail, pagertail += bytes; i != pagertail; ++i) {
+         if (pagerbuf[i & (PAGER_BUFFER-1)] != '\n') continue;
+         if (!pagerskip) {
+            pagerhead = pagerline;
+            end = i;
+            found = 1;
+         } else if (!found) pagerhead = i + 1;
+         pagerline = i + 1;
+         pagerskip = 0;
+      }
    }
+
+   if (found) pagerparse(pagerhead, end, monitor, desks);
+   pagerhead = pagerline;
 }
 
 int main(int argc, char **argv)
 {
    FILE *f;
-   int afds = 1;
-   fd_set rfds;
-   struct timeval tv;
-   struct pollfd fd2[afds];
-   int fd, lfd, rc = 0;
-   int desks = 0, layouts = 0, mode = 0;
-   int monitor = 0, i = 0, cycles = 0;
-   char update = 0;
-   snd_mixer_t *alsa; snd_mixer_elem_t *mixer;
-   memset(&fd2, 0, sizeof(fd2));
+   struct epoll_event events[LENGTH(source)];
+   struct pollfd *afds;
+   int afdc, efd, fd, n, i, seg, dirty;
+   int desks = 0, monitor = 0;
+   uint64_t expirations;
+   snd_mixer_t *alsa;
 
    /* check args */
    if (argc < 2)
       die("usage: %s <fifo> [monitor]\n", argv[0]);
 
+   if ((efd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+      die("could not create epoll instance\n");
+
    /* init alsa */
    if (!(alsa = alsainit("default")))
       die("Could not init ALSA (%s)\n", "default");
    /* get mixer */
    if (!(mixer = alsamixer(alsa, "Master")))
       die("Could not get mixer (%s)\n", "Master");
-   /* get fds for select */
-   snd_mixer_poll_descriptors(alsa, fd2, sizeof(fd2));
+   /* watch every fd of the mixer */
+   if ((afdc = snd_mixer_poll_descriptors_count(alsa)) < 0 ||
+         !(afds = calloc(afdc, sizeof(struct pollfd))))
+      die("Could not get mixer descriptors\n");
+   afdc = snd_mixer_poll_descriptors(alsa, afds, afdc);
+   for (i = 0; i < afdc; ++i)
+      watch(efd, afds[i].fd, SEG_VOLUME, SRC_FILE);
+   free(afds);
 
    if ((f = fopen(argv[1], "r")))
       fclose(f);
@@ -487,9 +723,11 @@ int main(int argc, char **argv)
          die("could not  create fifo\n");
    }
 
-   /* open fifo */
-   if ((fd = open(argv[1], O_RDONLY|O_NONBLOCK)) == -1)
+   /* open fifo, for writing as well so there is
+    * always a writer and it never reads eof */
+   if ((fd = open(argv[1], O_RDWR|O_NONBLOCK|O_CLOEXEC)) == -1)
       die("could not open fifo\n");
+   watch(efd, fd, SEG_PAGER, SRC_FILE);
 
    /* assign monitor */
    if (argc > 2)
@@ -503,65 +741,64 @@ int main(int argc, char **argv)
    }
    for (layouts = 0; layout[layouts].n; ++layouts);
 
+   /* the rest of the segments are refreshed on timers */
+   if (!(mpd = calloc(1, sizeof(mpdclient))))
+      die("mpdclient allocation failed");
+   mpd->backoff = 1;
+   mpd->timer = every(efd, SEG_MPD, MPD_INTERVAL, 0);
+   mpd_connect(efd);
+   every(efd, SEG_COWER, UPDATE_INTERVAL, 0);
+   every(efd, SEG_PACMAN, UPDATE_INTERVAL, 0);
+#if PANDORA
+   every(efd, SEG_BATTERY, BAT_INTERVAL, 0);
+#endif
+   every(efd, SEG_DATE, DATE_INTERVAL, 1);
+
+   /* probes are reaped on exit, and run in the background */
+   signal(SIGCHLD, SIG_IGN);
+   for (seg = 0; seg != SEG_LAST; ++seg)
+      if (probe[seg].argv[0]) {
+         probe[seg].src.segment = seg;
+         probe[seg].src.type = SRC_PROBE;
+         probestart(efd, &probe[seg]);
+      }
+
    /* init */
-   FD_ZERO(&rfds);
+   for (seg = 0; seg != SEG_LAST; ++seg)
+      if (seg != SEG_BATTERY || PANDORA) refresh(seg);
+   draw();
 
-   /* statusbar itself (pipe to lemonbar) */
+   /* statusbar itself (pipe to lemonbar),
+    * redrawn only when a segment changed */
    while (1) {
-      /* left */
-      alignleft();
-      //printf(" \\f2|");
-      printf(" ");
-      if (FD_ISSET(fd, &rfds)) {
-         monsterpager(argv[1], fd, monitor, desks, &mode);
-      } else {
-         printdata();
+      /* only a signal is worth waiting again for,
+       * any other error would fail again at once */
+      if ((n = epoll_wait(efd, events, LENGTH(events), -1)) == -1) {
+         if (errno == EINTR) continue;
+         die("could not wait for events (%s)\n", strerror(errno));
       }
-      printf("\\f2| ");
-      printlayout(mode<layouts?mode:0);
-
-      /* center */
-      aligncenter();
 
-      /* right */
-      alignright();
-      if (printmpd()) whitespace();
-      printcower(update);
-      whitespace();
-      printpacman(update);
-      whitespace();
-      printvolume(mixer);
-#if 0  /* PANDORA */
-      whitespace();
-      printbattery();
-#endif
-      whitespace();
-      printdate();
-      printf(" ");
-      eol();
-      fflush(stdout);
-
-      FD_ZERO(&rfds);
-      FD_SET((lfd = fd), &rfds);
-      for (i = 0; i != afds; ++i)
-         if (fd2[i].fd) {
-            if (fd2[i].fd > lfd) lfd = fd2[i].fd;
-            FD_SET(fd2[i].fd, &rfds);
-         }
-      tv.tv_sec = SLEEP_INTERVAL/1000;
-      tv.tv_usec = 0;
-      select(lfd + 1, &rfds, NULL, NULL, &tv);
-
-      if (!(update = FD_ISSET(fd, &rfds))){
-         for (i = 0; i != afds; ++i)
-            if (fd2[i].fd && FD_ISSET(fd2[i].fd, &rfds)) {
-               update = 1;
-               break;
+      for (dirty = 0, i = 0; i != n; ++i) {
+         source_t *src = events[i].data.ptr;
+         if (src->type == SRC_TIMER) {
+            read(src->fd, &expirations, sizeof(expirations));
+            if (probe[src->segment].argv[0]) {
+               probestart(efd, &probe[src->segment]);
+               continue;
             }
+            if (src->segment == SEG_MPD && !mpd->connection)
+               mpd_connect(efd);
+         } else if (src->type == SRC_PROBE)
+            proberead(efd, &probe[src->segment]);
+         else if (src->segment == SEG_PAGER)
+            monsterpager(src->fd, monitor, desks);
+         else if (src->segment == SEG_VOLUME)
+            snd_mixer_handle_events(alsa);
+         else if (src->segment == SEG_MPD && mpd->connection)
+            mpd_changed();
+         dirty |= refresh(src->segment);
       }
-      if (!update) cycles = 0;
-      else if (++cycles > 1) usleep(5000);
-      snd_mixer_handle_events(alsa);
+      if (dirty) draw();
    }
 
    mpd_quit();
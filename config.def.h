@@ -14,7 +14,7 @@
 #define SHOW_PANEL      True      /* show panel by default on exec */
 #define TOP_PANEL       True      /* False means panel is on bottom */
 #define PANEL_HEIGHT    18        /* 0 for no space for panel, thus no panel */
-#define DEFAULT_MODE    TILE      /* initial layout/mode: TILE MONOCLE BSTACK GRID FLOAT */
+#define DEFAULT_MODE    TILE      /* initial layout/mode, see the layouts below */
 #define ATTACH_ASIDE    True      /* False means new window is master */
 #define FOLLOW_WINDOW   False     /* follow the window when moved to a different desktop */
 #define FOLLOW_MONITOR  True      /* follow the window when moved to a different monitor */
@@ -26,10 +26,41 @@
 #define UNFOCUS         "#444444" /* unfocused window border color */
 #define INFOCUS         "#9c3885" /* focused window border color on unfocused monitor */
 #define MINWSZ          50        /* minimum window size in pixels */
+#define MOTION_RATE     60        /* window updates per second while dragging, 0 for every motion */
+#define UNMAP_HIDDEN    False     /* unmap the windows of hidden desktops instead of moving them off screen */
+#define INFO_JSON       False     /* output only the desktops that changed, as JSON lines */
+#define IPC_SOCKET      "monsterwm.sock" /* name of the command socket in $XDG_RUNTIME_DIR, NULL for none */
+#define BUILTIN_BAR     False     /* draw a bar in the panel space, instead of leaving it for an external bar */
+#define BAR_FONT        "fixed"   /* core font of the built-in bar */
+#define BAR_FG          "#c0c0c0" /* built-in bar text color */
+#define BAR_BG          "#1c1c1c" /* built-in bar background color */
+#define BAR_URGENT      "#ff8700" /* built-in bar color of desktops with urgent windows */
+#define STATUS_FIFO     "monsterwm.status" /* fifo of the built-in bar status text in $XDG_RUNTIME_DIR, NULL for none */
 #define DEFAULT_MONITOR 0         /* the monitor to focus initially */
 #define DEFAULT_DESKTOP 0         /* the desktop to focus initially */
 #define DESKTOPS        4         /* number of desktops - edit DESKTOPCHANGE keys to suit */
 
+/**
+ * layouts aka modes, and the functions that place the tiled windows
+ * of a desktop in each mode. FLOAT places no windows. modes can be
+ * added or removed, but MONOCLE, BSTACK and FLOAT are used by the wm.
+ * layout functions that are not listed are left out of the binary.
+ */
+enum { TILE, MONOCLE, BSTACK, GRID, SPIRAL, CENTER, DECK, COLUMNS, FLOAT, MODES };
+static void (*layout[MODES])(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) = {
+    [TILE]   = stack,  [MONOCLE] = monocle, [BSTACK] = stack, [GRID]    = grid,
+    [SPIRAL] = spiral, [CENTER]  = center,  [DECK]   = deck,  [COLUMNS] = columns,
+};
+#define COLUMN_WEIGHTS  { 2, 1, 1 } /* relative widths of the columns in COLUMNS mode */
+
+/**
+ * names of the modes shown by the built-in bar
+ */
+static const char *modenames[MODES] = {
+    [TILE]   = "[]=", [MONOCLE] = "[M]", [BSTACK] = "TTT", [GRID]    = "###",
+    [SPIRAL] = "[@]", [CENTER]  = "|M|", [DECK]   = "[D]", [COLUMNS] = "|||", [FLOAT] = "><>",
+};
+
 /**
  * layouts for monitors, terminate with -1
  */
@@ -48,6 +79,8 @@ static const MonitorCfg monitorcfg[] = {
 /**
  * open applications to specified monitor and desktop
  * with the specified properties.
+ * the class is matched against the window's class or instance name,
+ * prefix it with "role:" or "title:" to match the window's role or title
  * if monitor is negative, then current is assumed
  * if desktop is negative, then current is assumed
  */
@@ -132,9 +165,14 @@ static Key keys[] = {
     {  MOD4|SHIFT,       XK_m,          switch_mode,       {.i = MONOCLE}},
     {  MOD4|SHIFT,       XK_b,          switch_mode,       {.i = BSTACK}},
     {  MOD4|SHIFT,       XK_g,          switch_mode,       {.i = GRID}},
+    {  MOD4|SHIFT,       XK_s,          switch_mode,       {.i = SPIRAL}},
+    {  MOD4|SHIFT,       XK_e,          switch_mode,       {.i = CENTER}},
+    {  MOD4|SHIFT,       XK_d,          switch_mode,       {.i = DECK}},
+    {  MOD4|SHIFT,       XK_o,          switch_mode,       {.i = COLUMNS}},
     {  MOD4|SHIFT,       XK_f,          switch_mode,       {.i = FLOAT}},
     {  MOD4|CONTROL,     XK_r,          quit,              {.i = 0}}, /* quit with exit value 0 */
     {  MOD4|CONTROL,     XK_q,          quit,              {.i = 1}}, /* quit with exit value 1 */
+    {  MOD4|CONTROL|SHIFT, XK_r,        restart,           {NULL}},   /* restart keeping the windows */
     {  MOD4|SHIFT,       XK_Return,     spawn,             {.com = termcmd}},
     {  MOD4,             XK_p,          spawn,             {.com = menucmd}},
     {  MOD4,             XK_Down,       moveresize,        {.v = (int []){   0,  25,   0,   0 }}}, /* move up    */
@@ -7,23 +7,42 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xatom.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/Xlib-xcb.h>
 
 #define LENGTH(x)                (sizeof(x)/sizeof(*x))
 #define CLEANMASK(mask)          (mask & ~(numlockmask | LockMask))
 #define BUTTONMASK               ButtonPressMask|ButtonReleaseMask
+#define BINDCODE(code, mask)     (CLEANMASK(mask) << 8 | (code))
+#define BINDHASH(code)           ((code) * 2654435761u % LENGTH(bindings))
+#define BUTTONBIT                (1u << 31)
+#define AUTOMATON_RULES          16
 #define ISFFT(c)                 (c->isfull || c->isfloat || c->istrans)
-#define MVRSZ(c, _x, _y, _w, _h) XMoveResizeWindow(dis, c->win, c->x = _x, c->y = _y, _w, _h)
 #define MV(c, _x, _y)            XMoveWindow(dis, c->win, c->x = _x, c->y = _y)
+#define CELL(_x, _y, _w, _h)     (Rect){ _x, _y, (_w) - BORDER_WIDTH, (_h) - BORDER_WIDTH }
+#ifdef PROFILE
+#define PROF(slot, call)         do { Mark pm_; profmark(&pm_); call; profend(slot, &pm_); } while (0)
+#else
+#define PROF(slot, call)         call
+#endif
 
 enum { RESIZE, MOVE };
-enum { TILE, MONOCLE, BSTACK, GRID, FLOAT, MODES };
-enum { WM_PROTOCOLS, WM_DELETE_WINDOW, UTF8_STRING, WM_COUNT };
+enum { WM_PROTOCOLS, WM_DELETE_WINDOW, UTF8_STRING, WM_ROLE, WM_STATE, WM_COUNT };
+enum { RULE_CLASS, RULE_ROLE, RULE_TITLE, RULE_PROPS };
+enum { STATE_FLOAT = 1, STATE_FULL = 2, STATE_CURR = 4, STATE_PREV = 8 };
 enum { NET_SUPPORTED, NET_FULLSCREEN, NET_WM_STATE, NET_ACTIVE, NET_WM_NAME, NET_COUNT };
 
 /**
@@ -69,7 +88,8 @@ typedef struct {
  * define behavior of certain applications
  * configured in config.h
  *
- * class   - the class or name of the instance
+ * class   - the class or name of the instance, or its role or title if
+ *           prefixed with "role:" or "title:" (see compilerules)
  * desktop - what desktop it should be spawned at
  * follow  - whether to change desktop focus to the specified desktop
  */
@@ -91,6 +111,26 @@ typedef struct {
     const int *layout;
 } MonitorCfg;
 
+/**
+ * the geometry a layout computes for a tiled window
+ */
+typedef struct {
+    int x, y, w, h;
+} Rect;
+
+typedef struct Desktop Desktop;
+
+/* layout function prototypes sorted alphabetically
+ * layouts can be left out of the layout[] array in config.h
+ * and are then not compiled in */
+static void center(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void columns(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void deck(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void grid(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void monocle(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void spiral(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+static void stack(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) __attribute__((unused));
+
 /* exposed function prototypes sorted alphabetically */
 static void change_desktop(const Arg *arg);
 static void change_monitor(const Arg *arg);
@@ -108,6 +148,7 @@ static void prev_win();
 static void quit(const Arg *arg);
 static void resize_master(const Arg *arg);
 static void resize_stack(const Arg *arg);
+static void restart();
 static void rotate(const Arg *arg);
 static void rotate_filled(const Arg *arg);
 static void spawn(const Arg *arg);
@@ -125,20 +166,32 @@ static void togglefullscreen();
  * holds some properties for that window
  *
  * next    - the client after this one, or NULL if the current is the last client
+ * prev    - the client before this one, or the last client if the current is the head
  * isurgn  - set when the window received an urgent hint
  * isfull  - set when the window is fullscreen
  * isfloat - set when the window is floating
  * istrans - set when the window is transient
+ * ishide  - set when the window is unmapped because its desktop is hidden
  * win     - the window this client is representing
+ * x, y    - the last position the window was moved to
+ * w, h    - the last size the window was resized to
+ * bw      - the last border width set for the window, -1 if unknown
+ * bc      - the last border color set for the window
+ * pos     - the window's place in the desktop's stack when last restacked, -1 if unknown
+ * grab    - whether the focus button is grabbed, -1 if no buttons are grabbed yet
+ * mon     - the index of the monitor the client belongs to
+ * desk    - the index of the desktop the client belongs to
+ * unmaps  - the number of unmap notifications caused by hiding the window
  *
  * istrans is separate from isfloat as floating windows can be reset to
  * their tiling positions, while the transients will always be floating
  */
 typedef struct Client {
-    struct Client *next;
-    Bool isurgn, isfull, isfloat, istrans;
+    struct Client *next, *prev;
+    Bool isurgn, isfull, isfloat, istrans, ishide;
     Window win;
-    int x, y;
+    int x, y, w, h, bw, pos, grab, mon, desk, unmaps;
+    unsigned long bc;
 } Client;
 
 /**
@@ -151,12 +204,29 @@ typedef struct Client {
  * curr - the currently highlighted window
  * prev - the client that previously had focus
  * sbar - the visibility status of the panel/statusbar
+ * dirty - whether the desktop needs to be tiled at the end of the event batch
+ * count - the number of clients on the desktop
+ * urgn  - the number of clients on the desktop with an urgent hint
+ * info  - the values last output about the desktop, -1 before any (see desktopinfo)
  */
-typedef struct {
-    int mode, masz, sasz;
+struct Desktop {
+    int mode, masz, sasz, count, urgn, info[5];
     Client *head, *curr, *prev;
-    Bool sbar;
-} Desktop;
+    Bool sbar, dirty;
+};
+
+/**
+ * a part of the built-in bar, only drawn again when it changes
+ *
+ * x, w   - the position and width of the segment on the bar
+ * fg, bg - the colors of the segment
+ * text   - the text shown on the segment
+ */
+typedef struct {
+    int x, w;
+    unsigned long fg, bg;
+    char text[256];
+} Segment;
 
 /**
  * properties of each monitor
@@ -165,41 +235,164 @@ typedef struct {
  * wh, ww      - the width and height of the monitor
  * currdeskidx - the current desktop
  * desktops    - the desktops handled by the monitor
+ * bar         - the window of the built-in bar, None until it is first shown
+ * buf         - the pixmap the bar is drawn on and copied to the window from
+ * barmapped   - whether the bar window is mapped, it is unmapped while the panel is hidden
+ * segs        - the segments drawn on the bar, one per desktop, the mode and the status
  */
 typedef struct Monitor {
     int x, y, h, w, currdeskidx, prevdeskidx;
     Desktop desktops[DESKTOPS];
+    Window bar;
+    Pixmap buf;
+    Bool barmapped;
+    Segment segs[DESKTOPS + 2];
 } Monitor;
 
+/**
+ * clients are allocated in chunks, freed clients are
+ * kept in a free list and reused by the next new client
+ *
+ * next - the chunk allocated before this one
+ * c    - the clients of the chunk
+ */
+typedef struct Chunk {
+    struct Chunk *next;
+    Client c[32];
+} Chunk;
+
+/**
+ * the pattern of an app rule without its prefix, and the property it matches
+ */
+typedef struct {
+    const char *s;
+    int p;
+} Pattern;
+
+/**
+ * with AUTOMATON_RULES rules or more, the app rules are compiled to an
+ * aho-corasick automaton for each window property they match, all states
+ * kept in a single array. the state reached on each byte is looked up in
+ * a table with a row per state and a column per class of bytes, the bytes
+ * in no pattern sharing a class (see compileautomaton).
+ *
+ * fail    - the state of the longest proper suffix of this state's string
+ * rule    - the first rule matching any suffix of this state's string
+ */
+typedef struct {
+    unsigned int fail, rule;
+} State;
+
+/**
+ * the requests sent about a window that is to be managed,
+ * whose replies are collected by manage()
+ *
+ * ac, gc - the window's attributes and geometry
+ * cc, tc - the window's WM_CLASS and WM_TRANSIENT_FOR properties
+ * sc     - the window's _NET_WM_STATE property
+ * rc     - the window's WM_WINDOW_ROLE, if an app rule matches the role
+ * nc, wc - the window's _NET_WM_NAME and WM_NAME, if an app rule matches the title
+ */
+typedef struct {
+    xcb_get_window_attributes_cookie_t ac;
+    xcb_get_geometry_cookie_t gc;
+    xcb_get_property_cookie_t cc, tc, sc, rc, nc, wc;
+} Query;
+
+#ifdef PROFILE
+/**
+ * profile builds account what each event handler, command and
+ * hot path costs, in slots that follow the event types
+ *
+ * t   - the time the profiled call started
+ * req - the sequence number of the next request when it started
+ * rt  - the round trips counted when it started
+ * out - the bytes written to the server when it started
+ */
+typedef struct {
+    struct timespec t;
+    unsigned long req, rt;
+    uint64_t out;
+} Mark;
+
+enum { PROF_RETILE = LASTEvent, PROF_INFO, PROF_FOCUS, PROF_IPC, PROF_GEOM, PROF_COMMAND };
+#endif
+
 /* hidden function prototypes sorted alphabetically */
-static Client* addwindow(Window w, Desktop *d);
+static void addbinding(unsigned int code, unsigned int idx);
+static Client* addwindow(Window w, int cm, int cd);
+static void attach(Client *c, Client *n, Desktop *d);
 static void buttonpress(XEvent *e);
 static void cleanup(void);
 static void clientmessage(XEvent *e);
+static void coalesce(XEvent *e);
+static void compileautomaton(void);
+static void compilerules(const AppRule *r, unsigned int n);
+static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
+static int copyprop(xcb_get_property_reply_t *r, char *s, size_t size);
 static void deletewindow(Window w);
 static void desktopinfo(void);
+static void detach(Client *c, Desktop *d);
 static void destroynotify(XEvent *e);
 static void enternotify(XEvent *e);
+static void expose(XEvent *e);
 static void focus(Client *c, Desktop *d, Monitor *m);
 static void focusin(XEvent *e);
+static void freebar(Monitor *m);
+static void freeclient(Client *c);
 static unsigned long getcolor(const char* color, const int screen);
 static void grabbuttons(Client *c);
 static void grabkeys(void);
-static void grid(int x, int y, int w, int h, const Desktop *d);
+static void hide(Client *c);
+static void ipcaccept(void);
+static void ipccommand(int fd, char *line);
+static void ipcread(unsigned int i);
+static void ipcreply(int fd, const char *fmt, ...);
 static void keypress(XEvent *e);
+static void mappingnotify(XEvent *e);
+static void manage(Window w, const Query *q, const long *saved);
 static void maprequest(XEvent *e);
-static void monocle(int x, int y, int w, int h, const Desktop *d);
+static unsigned int matchrule(int p, const char *s, unsigned int r);
+static Client* newclient(void);
 static Client* prevclient(Client *c, Desktop *d);
+#ifdef PROFILE
+static int profafter(Display *dis);
+static void profatom(Atom a);
+static void profend(unsigned int s, const Mark *pm);
+static uint64_t profflush(void);
+static void proflog(const XEvent *e);
+static void profmark(Mark *pm);
+static void profreport(void);
+static unsigned int profslot(void (*func)(const Arg *));
+static void profwindow(Window w);
+#endif
 static void propertynotify(XEvent *e);
+static void query(Window w, Query *q);
+static void randrnotify(XEvent *e);
+static void readstatus(void);
 static void removeclient(Client *c, Desktop *d, Monitor *m);
+static void resize(Client *c, int x, int y, int w, int h);
+static void retile(void);
 static void run(void);
+static Bool runtimepath(char *path, size_t size, const char *name);
+static void savestate(void);
+static void scan(void);
+static void setborder(Client *c, int bw);
 static void setfullscreen(Client *c, Desktop *d, Monitor *m, Bool fullscrn);
 static void setup(void);
+static void setwmstate(Window w, long state);
+static void show(Client *c);
 static void sigchld(int sig);
-static void stack(int x, int y, int w, int h, const Desktop *d);
+#ifdef PROFILE
+static void sigusr1(int sig);
+#endif
+static int statecmp(const void *a, const void *b);
+static Bool supersedes(Display *dis, XEvent *e, XPointer arg);
 static void tile(Desktop *d, Monitor *m);
 static void unmapnotify(XEvent *e);
+static void updatebar(Monitor *m);
+static void updategeom(void);
 static Bool wintoclient(Window w, Client **c, Desktop **d, Monitor **m);
 static int xerror(Display *dis, XErrorEvent *ee);
 static int xerrorstart(Display *dis, XErrorEvent *ee);
@@ -208,6 +401,11 @@ static int xerrorstart(Display *dis, XErrorEvent *ee);
  * global variables
  *
  * running      - whether the wm is accepting and processing more events
+ * restarting   - whether the wm should execute itself again once it stops running
+ * dirtyinfo    - whether desktop info should be output at the end of the event batch
+ * dirtygeom    - whether the monitors should be queried again at the end of the event batch
+ * adopting     - whether the windows found on start are being managed, to be placed at once (see scan)
+ * randrbase    - the first event number of the randr extension, -1 without it
  * wh           - screen height
  * ww           - screen width
  * dis          - the display aka dpy
@@ -216,14 +414,78 @@ static int xerrorstart(Display *dis, XErrorEvent *ee);
  * netatoms     - array holding atoms for EWMH support
  * dekstops     - array of managed desktops
  * currdeskidx  - which desktop is currently active
- */
-static Bool running = True;
+ * clientctx    - context mapping each managed window to its client
+ * chunks       - the chunks clients are allocated from
+ * pool         - the free list of clients in the chunks
+ * patterns     - the pattern and property of each app rule
+ * npatterns    - the number of app rules
+ * states       - the states of the compiled app rules, NULL if they are tried one by one
+ * moves        - the state reached from each state on each class of bytes
+ * byteclass    - the class of each byte, 0 for the bytes in no pattern
+ * nclasses     - the number of classes of bytes
+ * roots        - the root state of the automaton of each matched property
+ * hasrules     - whether any app rule matches the property
+ * bindings     - hash table of the key and button bindings (see addbinding)
+ * ipcfd        - the listening command socket, -1 if there is none
+ * conns        - the connections to the command socket and their unread input
+ * rects        - the geometry computed by a layout for the tiled clients
+ * nrects       - the number of clients rects has room for
+ * barfont      - the font of the built-in bar
+ * bargc        - the graphics context the built-in bar is drawn with
+ * statusfd     - the fifo the status text of the built-in bar is read from, -1 if there is none
+ * status       - the status text shown on the built-in bar
+ * statusbuf    - the status text read after the last whole line
+ * statusskip   - whether the line being read did not fit in statusbuf and is dropped
+ */
+static Bool running = True, dirtyinfo, dirtygeom, restarting, adopting;
+static int randrbase = -1;
 static int nmonitors, off_x, off_y, currmonidx, retval;
 static unsigned int numlockmask, win_focus, win_unfocus, win_infocus;
 static Display *dis;
 static Window root;
 static Atom wmatoms[WM_COUNT], netatoms[NET_COUNT];
 static Monitor *monitors;
+static XContext clientctx;
+static Chunk *chunks;
+static Client *pool;
+static Pattern *patterns;
+static unsigned int npatterns;
+static State *states;
+static unsigned int *moves, nclasses;
+static unsigned char byteclass[256];
+static unsigned int roots[RULE_PROPS];
+static Bool hasrules[RULE_PROPS];
+static struct { unsigned int code, idx; } bindings[2*(LENGTH(keys) + LENGTH(buttons)) + 1];
+static int ipcfd = -1;
+static struct sockaddr_un ipcaddr = { .sun_family = AF_UNIX };
+static struct { int fd; unsigned int len; char buf[256]; } conns[16];
+static Rect *rects;
+static int nrects;
+static XFontStruct *barfont;
+static GC bargc;
+static unsigned long bar_fg, bar_bg, bar_urgent;
+static int statusfd = -1;
+static unsigned int statuslen;
+static Bool statusskip;
+static char status[256], statusbuf[sizeof(status) + 1];
+
+#ifdef DEBUG
+/**
+ * counters reported on exit by debug builds
+ *
+ * hits       - window lookups that found a client
+ * misses     - window lookups for unmanaged windows
+ * issued     - move/resize requests sent to the server
+ * suppressed - move/resize requests dropped as the geometry was unchanged
+ * unsynced   - focus changes and configure requests that did not wait on the server
+ * clients    - clients currently allocated from the pool
+ * highwater  - most clients allocated from the pool at once
+ * nchunks    - chunks allocated for the pool
+ * motions    - pointer motion events received while dragging a window
+ * drags      - geometry requests sent while dragging a window
+ */
+static struct { unsigned long hits, misses, issued, suppressed, unsynced, clients, highwater, nchunks, motions, drags; } stats;
+#endif
 
 /**
  * array of event handlers
@@ -237,25 +499,93 @@ static void (*events[LASTEvent])(XEvent *e) = {
     [ButtonPress]      = buttonpress,  [DestroyNotify]  = destroynotify,
     [UnmapNotify]      = unmapnotify,  [PropertyNotify] = propertynotify,
     [ConfigureRequest] = configurerequest,    [FocusIn] = focusin,
+    [MappingNotify]    = mappingnotify, [ConfigureNotify] = configurenotify,
+    [Expose]           = expose,
 };
 
 /**
- * array of layout handlers
+ * commands accepted on the command socket
  *
- * x - the start position in the x axis to place clients
- * y - the start position in the y axis to place clients
- * w - available width  that windows have to expand
- * h - available height that windows have to expand
- * d - the desktop to tile its clients
+ * each command is a line holding the name of the command,
+ * optionally followed by an integer argument, and calls the
+ * function with that argument. the queries "info" and "window"
+ * are answered by ipccommand
  */
-static void (*layout[MODES])(int x, int y, int w, int h, const Desktop *d) = {
-    [TILE] = stack, [BSTACK] = stack, [GRID] = grid, [MONOCLE] = monocle,
+static const struct {
+    const char *name;
+    void (*func)(const Arg *);
+} commands[] = {
+    { "change_desktop",    change_desktop    }, { "change_monitor",    change_monitor    },
+    { "client_to_desktop", client_to_desktop }, { "client_to_monitor", client_to_monitor },
+    { "focusurgent",       focusurgent       }, { "killclient",        killclient        },
+    { "last_desktop",      last_desktop      }, { "move_down",         move_down         },
+    { "move_up",           move_up           }, { "next_win",          next_win          },
+    { "prev_win",          prev_win          }, { "quit",              quit              },
+    { "resize_master",     resize_master     }, { "resize_stack",      resize_stack      },
+    { "restart",           restart           }, { "rotate",            rotate            },
+    { "rotate_filled",     rotate_filled     }, { "swap_master",       swap_master       },
+    { "switch_mode",       switch_mode       }, { "togglefullscreen",  togglefullscreen  },
+    { "togglepanel",       togglepanel       },
+};
+
+#ifdef PROFILE
+/**
+ * profile slots, one per event type, then the hot paths that are
+ * not event handlers, then one per command and one for the functions
+ * bound to keys that are not commands. slots nest, so a command
+ * called from keypress is accounted to both.
+ *
+ * calls     - times the slot was entered
+ * usec, max - the total and the longest wall time spent, in microseconds
+ * requests  - requests sent to the server
+ * bytes     - bytes written to the server (see profflush)
+ * trips     - round trips, requests that waited for the server (see profafter)
+ * hist      - calls by wall time, bucket i counting calls under 2^i us
+ *             and not in an earlier bucket, the last one all the others
+ */
+static struct {
+    unsigned long calls, usec, max, requests, bytes, trips, hist[16];
+} prof[PROF_COMMAND + LENGTH(commands) + 1];
+static const char *profnames[PROF_COMMAND] = {
+    [KeyPress]         = "keypress",         [EnterNotify]     = "enternotify",
+    [MapRequest]       = "maprequest",       [ClientMessage]   = "clientmessage",
+    [ButtonPress]      = "buttonpress",      [DestroyNotify]   = "destroynotify",
+    [UnmapNotify]      = "unmapnotify",      [PropertyNotify]  = "propertynotify",
+    [ConfigureRequest] = "configurerequest", [FocusIn]         = "focusin",
+    [MappingNotify]    = "mappingnotify",    [ConfigureNotify] = "configurenotify",
+    [Expose]           = "expose",
+    [PROF_RETILE]      = "retile",           [PROF_INFO]       = "desktopinfo",
+    [PROF_FOCUS]       = "focus",            [PROF_IPC]        = "ipc",
+    [PROF_GEOM]        = "updategeom",
 };
+static unsigned long trips, lastknown, lastusec, lastreqs, lastbytes;
+static volatile sig_atomic_t dumpprof;
+static FILE *evlog;
+static struct timespec evstart;
+#endif
+
+/**
+ * add a binding to the bindings hash table
+ *
+ * code is the keycode, or the button with BUTTONBIT set,
+ * along with the cleaned modifiers (see BINDCODE) and idx
+ * is the index of the binding in keys[] or buttons[].
+ *
+ * collisions are resolved by linear probing, bindings of the
+ * same code are found in the order they were added, by probing
+ * from the code's hash until an empty slot (see keypress).
+ */
+void addbinding(unsigned int code, unsigned int idx) {
+    unsigned int s = BINDHASH(code);
+    while (bindings[s].code) s = (s + 1) % LENGTH(bindings);
+    bindings[s].code = code; bindings[s].idx = idx;
+}
 
 /**
- * add the given window to the given desktop
+ * add the given window to the given desktop of the given monitor
  *
  * create a new client to hold the new window
+ * and index it by its window (see wintoclient)
  *
  * if there is no head at the given desktop
  * add the window as the head
@@ -263,17 +593,33 @@ static void (*layout[MODES])(int x, int y, int w, int h, const Desktop *d) = {
  * add the window as the last client
  * otherwise add the window as head
  */
-Client* addwindow(Window w, Desktop *d) {
-    Client *c = NULL, *t = prevclient(d->head, d);
-    if (!(c = (Client *)calloc(1, sizeof(Client)))) err(EXIT_FAILURE, "cannot allocate client");
-    if (!d->head) d->head = c;
-    else if (!ATTACH_ASIDE) { c->next = d->head; d->head = c; }
-    else if (t) t->next = c; else d->head->next = c;
+Client* addwindow(Window w, int cm, int cd) {
+    Desktop *d = &monitors[cm].desktops[cd];
+    Client *c = newclient();
+    attach(c, ATTACH_ASIDE ? NULL:d->head, d);
 
+    c->mon = cm; c->desk = cd; c->bw = c->pos = c->grab = -1; c->bc = ~0UL;
+    XSaveContext(dis, w, clientctx, (XPointer)c);
     XSelectInput(dis, (c->win = w), PropertyChangeMask|FocusChangeMask|(FOLLOW_MOUSE?EnterWindowMask:0));
     return c;
 }
 
+/**
+ * link the client to the desktop's client list before client n,
+ * or as the last client if n is NULL
+ *
+ * the list is linked both ways and the head's prev is the last
+ * client, so the previous and the last clients are always at hand
+ */
+void attach(Client *c, Client *n, Desktop *d) {
+    d->count++; d->urgn += c->isurgn;
+    if (!d->head) { c->next = NULL; d->head = c->prev = c; return; }
+    c->next = n;
+    c->prev = n ? n->prev:d->head->prev;
+    if (n == d->head) d->head = c; else c->prev->next = c;
+    if (n) n->prev = c; else d->head->prev = c;
+}
+
 /**
  * on the press of a key binding (see grabkeys)
  * call the appropriate handler
@@ -289,28 +635,45 @@ void buttonpress(XEvent *e) {
         focus(c, d, m);
     }
 
-    for (unsigned int i = 0; i < LENGTH(buttons); i++)
-        if (CLEANMASK(buttons[i].mask) == CLEANMASK(e->xbutton.state) &&
-            buttons[i].func && buttons[i].button == e->xbutton.button) {
+    unsigned int code = BINDCODE(e->xbutton.button, e->xbutton.state) | BUTTONBIT;
+    for (unsigned int s = BINDHASH(code), i = 0; bindings[s].code; s = (s + 1) % LENGTH(bindings))
+        if (bindings[s].code == code && buttons[(i = bindings[s].idx)].func) {
             if (w && cm != currmonidx) change_monitor(&(Arg){.i = cm});
             if (w && c != d->curr) focus(c, d, m);
-            buttons[i].func(&(buttons[i].arg));
+            PROF(profslot(buttons[i].func), buttons[i].func(&(buttons[i].arg)));
         }
 }
 
+/**
+ * centered master layout
+ * the master window is in the middle, and the stack windows
+ * alternate between a column to its right and one to its left
+ */
+void center(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) {
+    int ma = (w -= BORDER_WIDTH) * MASTER_SIZE + d->masz, nl = (n - 1)/2, nr = n/2;
+    int lw = n > 2 ? (w - ma)/2:0, rw = w - ma - lw;
+    h -= BORDER_WIDTH;
+
+    r[0] = CELL(x + lw, y, n > 1 ? ma:w, h);
+    for (int i = 1; i < n; i++) {
+        int k = (i - 1)/2, rows = (i % 2 ? nr:nl);
+        r[i] = CELL(i % 2 ? x + lw + ma:x, y + k*h/rows, i % 2 ? rw:lw, (k + 1)*h/rows - k*h/rows);
+    }
+}
+
 /**
  * focus another desktop
- * move in new windows
- * move out old windows
+ * show new windows
+ * hide old windows
  */
 void change_desktop(const Arg *arg) {
     Monitor *m = &monitors[currmonidx];
     if (arg->i == m->currdeskidx || arg->i < 0 || arg->i >= DESKTOPS) return;
     Desktop *d = &m->desktops[(m->prevdeskidx = m->currdeskidx)], *n = &m->desktops[(m->currdeskidx = arg->i)];
-    for (Client *c = n->head; c; c = c->next) MV(c, c->x - off_x, c->y - off_y);
+    for (Client *c = n->head; c; c = c->next) show(c);
     if (n->head) { tile(n, m); focus(n->curr, n, m); }
-    for (Client *c = d->head; c; c = c->next) MV(c, c->x + off_x, c->y + off_y);
-    desktopinfo();
+    for (Client *c = d->head; c; c = c->next) hide(c);
+    dirtyinfo = True;
 }
 
 /**
@@ -321,22 +684,47 @@ void change_monitor(const Arg *arg) {
     Monitor *m = &monitors[currmonidx], *n = &monitors[(currmonidx = arg->i)];
     focus(m->desktops[m->currdeskidx].curr, &m->desktops[m->currdeskidx], m);
     focus(n->desktops[n->currdeskidx].curr, &n->desktops[n->currdeskidx], n);
-    desktopinfo();
+    dirtyinfo = True;
 }
 
 /**
  * remove all windows in all desktops by sending a delete window message
+ *
+ * when restarting the windows are kept,
+ * to be managed again by the new wm (see scan)
  */
 void cleanup(void) {
-    Window root_return, parent_return, *children;
-    unsigned int nchildren;
+    Window root_return, parent_return, *children = NULL;
+    unsigned int nchildren = 0;
 
     XUngrabKey(dis, AnyKey, AnyModifier, root);
-    XQueryTree(dis, root, &root_return, &parent_return, &children, &nchildren);
+    for (int cm = 0; cm < nmonitors; cm++) freebar(&monitors[cm]);
+    if (bargc) XFreeGC(dis, bargc);
+    if (barfont) XFreeFont(dis, barfont);
+    if (statusfd >= 0) close(statusfd);
+    if (!restarting) XQueryTree(dis, root, &root_return, &parent_return, &children, &nchildren);
     for (unsigned int i = 0; i < nchildren; i++) deletewindow(children[i]);
     if (children) XFree(children);
     XSync(dis, False);
+    for (unsigned int i = 0; i < LENGTH(conns); i++) if (conns[i].fd >= 0) close(conns[i].fd);
+    if (ipcfd >= 0 && !close(ipcfd)) unlink(ipcaddr.sun_path);
     free(monitors);
+    for (Chunk *k = chunks; k; k = chunks) { chunks = k->next; free(k); }
+    free(patterns);
+    free(states);
+    free(moves);
+    free(rects);
+#ifdef PROFILE
+    profreport();
+    if (evlog) fclose(evlog);
+#endif
+#ifdef DEBUG
+    warnx("wintoclient: %lu hits %lu misses", stats.hits, stats.misses);
+    warnx("moveresize: %lu issued %lu suppressed", stats.issued, stats.suppressed);
+    warnx("xsync: %lu avoided", stats.unsynced);
+    warnx("pool: %lu clients %lu highwater %lu chunks", stats.clients, stats.highwater, stats.nchunks);
+    warnx("mousemotion: %lu motion events %lu geometry requests", stats.motions, stats.drags);
+#endif
 }
 
 /**
@@ -349,19 +737,21 @@ void client_to_desktop(const Arg *arg) {
     Monitor *m = &monitors[currmonidx]; Desktop *d = &m->desktops[m->currdeskidx], *n = NULL;
     if (arg->i == m->currdeskidx || arg->i < 0 || arg->i >= DESKTOPS || !d->curr) return;
 
-    Client *c = d->curr, *p = prevclient(d->curr, d),
-           *l = prevclient(m->desktops[arg->i].head, (n = &m->desktops[arg->i]));
+    Client *c = d->curr;
+    n = &m->desktops[arg->i];
 
     /* unlink current client from current desktop */
-    if (d->head == c || !p) d->head = c->next; else p->next = c->next;
-    c->next = NULL;
-    if (MV(c, c->x + off_x, c->y + off_y)) focus(d->prev, d, m);
+    detach(c, d);
+    hide(c);
+    focus(d->prev, d, m);
     if (!(c->isfloat || c->istrans) || (d->head && !d->head->next)) tile(d, m);
 
     /* link client to new desktop and make it the current */
-    focus(l ? (l->next = c):n->head ? (n->head->next = c):(n->head = c), n, m);
+    c->desk = arg->i; c->pos = -1;
+    attach(c, NULL, n);
+    focus(c, n, m);
 
-    if (FOLLOW_WINDOW) change_desktop(arg); else desktopinfo();
+    if (FOLLOW_WINDOW) change_desktop(arg); else dirtyinfo = True;
 }
 
 /**
@@ -381,11 +771,10 @@ void client_to_monitor(const Arg *arg) {
     if (arg->i == currmonidx || arg->i < 0 || arg->i >= nmonitors || !cd->curr) return;
 
     nd = &monitors[arg->i].desktops[(nm = &monitors[arg->i])->currdeskidx];
-    Client *c = cd->curr, *p = prevclient(c, cd), *l = prevclient(nd->head, nd);
+    Client *c = cd->curr;
 
     /* unlink current client from current monitor's current desktop */
-    if (cd->head == c || !p) cd->head = c->next; else p->next = c->next;
-    c->next = NULL;
+    detach(c, cd);
     if (MV(c, c->x + off_x, c->y + off_y)) focus(cd->prev, cd, cm);
     if (!(c->isfloat || c->istrans) || (cd->head && !cd->head->next)) tile(cd, cm);
 
@@ -393,10 +782,12 @@ void client_to_monitor(const Arg *arg) {
     if (ISFFT(c)) c->isfloat = c->isfull = False;
 
     /* link to new monitor's current desktop */
-    focus(l ? (l->next = c):nd->head ? (nd->head->next = c):(nd->head = c), nd, nm);
+    c->mon = arg->i; c->desk = nm->currdeskidx; c->pos = -1;
+    attach(c, NULL, nd);
+    focus(c, nd, nm);
     tile(nd, nm);
 
-    if (FOLLOW_MONITOR) change_monitor(arg); else desktopinfo();
+    if (FOLLOW_MONITOR) change_monitor(arg); else dirtyinfo = True;
 }
 
 /**
@@ -432,6 +823,143 @@ void clientmessage(XEvent *e) {
     } else if (e->xclient.message_type == netatoms[NET_ACTIVE]) focus(c, d, m);
 }
 
+/**
+ * replace the given event with the newest queued event that supersedes it
+ *
+ * a burst of events from one window often carries redundant requests,
+ * only the last of those needs to be handled:
+ *  - the last configure request of a window with the same value mask
+ *  - one property notification per window and atom, for the urgency
+ *    hints only, as the other properties are ignored (see propertynotify)
+ *  - the last of adjacent crossing events with the same mode and detail,
+ *    as that's where the pointer ended up
+ *  - the last of adjacent pointer motions on the same window
+ *
+ * crossing and motion events are only replaced by the events right after
+ * them, so they are never moved past other events, like a window being
+ * mapped or destroyed, that change which window gets the focus
+ */
+void coalesce(XEvent *e) {
+    XEvent ev;
+    if (e->type == ConfigureRequest || (e->type == PropertyNotify && e->xproperty.atom == XA_WM_HINTS))
+        while (XCheckIfEvent(dis, &ev, supersedes, (XPointer)e)) *e = ev;
+    else if (e->type == EnterNotify || e->type == MotionNotify)
+        while (QLength(dis) && (XPeekEvent(dis, &ev), supersedes(dis, &ev, (XPointer)e))) XNextEvent(dis, e);
+}
+
+/**
+ * columns layout
+ * windows are spread over as many columns as COLUMN_WEIGHTS has,
+ * each column as wide as its weight relative to the columns in use,
+ * and the windows of each column are stacked with equal height
+ */
+void columns(int x, int y, int w, int h, __attribute__((unused)) const Desktop *d, int n, Rect *r) {
+    static const int weights[] = COLUMN_WEIGHTS;
+    int cols = n < (int)LENGTH(weights) ? n:(int)LENGTH(weights), total = 0, sum = 0, cx = 0, i = 0;
+    for (int k = 0; k < cols; k++) total += weights[k];
+    w -= BORDER_WIDTH; h -= BORDER_WIDTH;
+
+    for (int k = 0; k < cols; k++) {
+        int cw = w * (sum += weights[k])/total - cx, rows = n/cols + (k < n % cols);
+        for (int j = 0; j < rows; j++, i++) r[i] = CELL(x + cx, y + j*h/rows, cw, (j + 1)*h/rows - j*h/rows);
+        cx += cw;
+    }
+}
+
+/**
+ * compile the n app rules r, split into their pattern and the property
+ * they match, and into an automaton for each property if there are many
+ *
+ * a rule is matched against the window's class and instance name,
+ * or against its role or title if prefixed with "role:" or "title:".
+ * with AUTOMATON_RULES rules or more, a window matching the pattern of
+ * any rule as a substring is found in a single pass over the window's
+ * property, however many rules there are, and the first such rule
+ * applies (see matchrule).
+ */
+void compilerules(const AppRule *r, unsigned int n) {
+    const char *prefix[RULE_PROPS] = { [RULE_CLASS] = "", [RULE_ROLE] = "role:", [RULE_TITLE] = "title:" };
+    free(patterns);
+    free(states);
+    free(moves);
+    states = NULL;
+    moves = NULL;
+    if (!(patterns = calloc(n + 1, sizeof(Pattern)))) err(EXIT_FAILURE, "cannot allocate rules");
+    for (int p = 0; p < RULE_PROPS; p++) hasrules[p] = False;
+    for (npatterns = 0; npatterns < n; npatterns++) {
+        int p = RULE_PROPS - 1;
+        while (p > RULE_CLASS && strncmp(r[npatterns].class, prefix[p], strlen(prefix[p]))) p--;
+        patterns[npatterns] = (Pattern){ r[npatterns].class + strlen(prefix[p]), p };
+        hasrules[p] = True;
+    }
+    if (n >= AUTOMATON_RULES) compileautomaton();
+}
+
+/**
+ * compile the patterns to one automaton per property, which only pays
+ * off over trying each pattern with strstr when there are many of them
+ *
+ * the patterns are first added to a trie whose states link their
+ * siblings, then breadth first the row of each state in moves is
+ * filled with its children, and for the bytes it has no child on,
+ * with the states reached from its longest proper suffix.
+ */
+void compileautomaton(void) {
+    typedef struct { unsigned int child, sibling; unsigned char ch; } Trie;
+    unsigned int n = RULE_PROPS, m = RULE_PROPS, s = 0, t = 0, q = 0;
+    for (unsigned int i = 0; i < npatterns; i++) n += strlen(patterns[i].s);
+    memset(byteclass, 0, sizeof(byteclass));
+    nclasses = 1;
+    for (unsigned int i = 0; i < npatterns; i++) for (const unsigned char *ch = (const unsigned char *)patterns[i].s; *ch; ch++)
+        if (!byteclass[*ch]) byteclass[*ch] = nclasses++;
+    Trie *trie = calloc(n, sizeof(Trie));
+    unsigned int *queue = calloc(n, sizeof(unsigned int));
+    free(states);
+    free(moves);
+    if (!trie || !queue || !(states = calloc(n, sizeof(State))) || !(moves = calloc((size_t)n * nclasses, sizeof(unsigned int))))
+        err(EXIT_FAILURE, "cannot allocate rules");
+    for (int p = 0; p < RULE_PROPS; p++) states[(roots[p] = p)] = (State){ .fail = p, .rule = npatterns };
+
+    /* add the pattern of each rule to the trie of its property */
+    for (unsigned int i = 0; i < npatterns; i++) {
+        const unsigned char *ch = (const unsigned char *)patterns[i].s;
+        for (s = roots[patterns[i].p]; *ch; s = t, ch++) {
+            for (t = trie[s].child; t && trie[t].ch != *ch; t = trie[t].sibling);
+            if (t) continue;
+            trie[(t = m++)] = (Trie){ .sibling = trie[s].child, .ch = *ch };
+            states[t].rule = npatterns;
+            trie[s].child = t;
+        }
+        if (i < states[s].rule) states[s].rule = i;
+    }
+
+    /* a root stays on the bytes it has no child on, any other state moves
+     * where its suffix does. each child's suffix is where the parent's
+     * suffix moves on its byte, and it takes the suffix' rule if earlier */
+    for (n = 0; n < RULE_PROPS; n++) queue[n] = n;
+    for (q = 0; q < n; q++) {
+        unsigned int *row = moves + (size_t)(s = queue[q]) * nclasses, f = states[s].fail;
+        for (unsigned int c = 0; c < nclasses; c++) row[c] = s < RULE_PROPS ? s:moves[(size_t)f * nclasses + c];
+        for (t = trie[s].child; t; t = trie[t].sibling) {
+            row[byteclass[trie[t].ch]] = t;
+            states[t].fail = s < RULE_PROPS ? s:moves[(size_t)f * nclasses + byteclass[trie[t].ch]];
+            if (states[states[t].fail].rule < states[t].rule) states[t].rule = states[states[t].fail].rule;
+            queue[n++] = t;
+        }
+    }
+    free(trie);
+    free(queue);
+}
+
+/**
+ * the root window is reconfigured when monitors are added,
+ * removed or change resolution, so update the monitors
+ * at the end of the event batch (see randrnotify)
+ */
+void configurenotify(XEvent *e) {
+    if (e->xconfigure.window == root) dirtygeom = True;
+}
+
 /**
  * configure a window's size, position, border width, and stacking order.
  *
@@ -456,13 +984,47 @@ void clientmessage(XEvent *e) {
  * or move windows around w/o the window manager's help, etc..
  * to disallow this behavior, we 'tile()' the desktop to which
  * the window that sent the configure request belongs.
+ *
+ * the request is not synced, a BadMatch or BadWindow error from
+ * a window that went away in the meantime is ignored by xerror().
  */
 void configurerequest(XEvent *e) {
     XConfigureRequestEvent *ev = &e->xconfigurerequest;
     XWindowChanges wc = { ev->x, ev->y,  ev->width, ev->height, ev->border_width, ev->above, ev->detail };
-    if (XConfigureWindow(dis, ev->window, ev->value_mask, &wc)) XSync(dis, False);
+    XConfigureWindow(dis, ev->window, ev->value_mask, &wc);
+#ifdef DEBUG
+    stats.unsynced++;
+#endif
     Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
-    if (wintoclient(ev->window, &c, &d, &m)) tile(d, m);
+    if (!wintoclient(ev->window, &c, &d, &m)) return;
+    /* the window no longer has the geometry we last gave it */
+    if (ev->value_mask & (CWX|CWY|CWWidth|CWHeight)) c->w = c->h = 0;
+    if (ev->value_mask & CWBorderWidth) c->bw = -1;
+    if (ev->value_mask & CWStackMode) c->pos = -1;
+    tile(d, m);
+}
+
+/**
+ * copy the value of the property reply to the given buffer, NUL terminated
+ * return the length of the value, 0 if there is no such property
+ */
+int copyprop(xcb_get_property_reply_t *r, char *s, size_t size) {
+    int len = r ? xcb_get_property_value_length(r):0;
+    if (len > 0) memcpy(s, xcb_get_property_value(r), (size_t)len < size - 1 ? (size_t)len:size - 1);
+    return len;
+}
+
+/**
+ * deck layout
+ * the master window is as in tile mode, and the stack
+ * windows are on top of each other in the stack area
+ */
+void deck(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) {
+    int ma = (w -= BORDER_WIDTH) * MASTER_SIZE + d->masz;
+    h -= BORDER_WIDTH;
+
+    r[0] = CELL(x, y, n > 1 ? ma:w, h);
+    for (int i = 1; i < n; i++) r[i] = CELL(x + ma, y, w - ma, h);
 }
 
 /**
@@ -493,21 +1055,62 @@ void deletewindow(Window w) {
  *   - whether the desktop is the current focused (1) or not (0)
  *   - whether any client in that desktop has received an urgent hint
  *
+ * when INFO_JSON is set, only the desktops whose values changed
+ * are output instead, each as a JSON object on a line of its own.
+ *
  * once the info is collected, immediately flush the stream
+ *
+ * handlers only mark the info as dirty, so that it is
+ * output once at the end of an event batch (see run).
+ * the client and urgent counts are kept by attach, detach and
+ * propertynotify, and nothing is output if no value changed.
+ *
+ * the built-in bar shows the same values, along with the status,
+ * so only the bars of monitors whose values or status changed,
+ * or whose panel was toggled, are drawn again.
  */
 void desktopinfo(void) {
     Monitor *m = NULL;
-    Client *c = NULL;
-    Bool urgent = False;
+    Desktop *d = NULL;
+    Bool changed = False, redraw[nmonitors];
 
+    memset(redraw, 0, sizeof(redraw));
     for (int cm = 0; cm < nmonitors; cm++)
-        for (int cd = 0, w = 0; cd < DESKTOPS; cd++, w = 0, urgent = False) {
-            for (m = &monitors[cm], c = m->desktops[cd].head; c; urgent |= c->isurgn, ++w, c = c->next);
-            printf("%d:%d:%d:%d:%d:%d:%d ", cm, cm == currmonidx, cd, w, m->desktops[cd].mode, cd == m->currdeskidx, urgent);
+        for (int cd = 0; cd < DESKTOPS; cd++) {
+            d = &(m = &monitors[cm])->desktops[cd];
+            int info[] = { cm == currmonidx, d->count, d->mode, cd == m->currdeskidx, d->urgn > 0 };
+            if (!memcmp(info, d->info, sizeof(info))) continue;
+            memcpy(d->info, info, sizeof(info));
+            changed = redraw[cm] = True;
+            if (INFO_JSON) printf("{\"monitor\":%d,\"focused\":%d,\"desktop\":%d,\"clients\":%d,"
+                                  "\"mode\":%d,\"current\":%d,\"urgent\":%d}\n",
+                                  cm, info[0], cd, info[1], info[2], info[3], info[4]);
         }
 
-    printf("\n");
-    fflush(stdout);
+    if (changed && !INFO_JSON) {
+        for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+            const int *info = monitors[cm].desktops[cd].info;
+            printf("%d:%d:%d:%d:%d:%d:%d ", cm, info[0], cd, info[1], info[2], info[3], info[4]);
+        }
+        printf("\n");
+    }
+    if (changed) fflush(stdout);
+    if (BUILTIN_BAR) for (int cm = 0; cm < nmonitors; cm++) {
+        m = &monitors[cm];
+        if (redraw[cm] || m->barmapped != (m->desktops[m->currdeskidx].sbar && PANEL_HEIGHT > 0)
+                || strcmp(status, m->segs[DESKTOPS + 1].text)) updatebar(m);
+    }
+    dirtyinfo = False;
+}
+
+/**
+ * unlink the client from the desktop's client list
+ */
+void detach(Client *c, Desktop *d) {
+    d->count--; d->urgn -= c->isurgn;
+    if (c == d->head) d->head = c->next; else c->prev->next = c->next;
+    if (c->next) c->next->prev = c->prev; else if (d->head) d->head->prev = c->prev;
+    c->next = c->prev = NULL;
 }
 
 /**
@@ -539,12 +1142,24 @@ void enternotify(XEvent *e) {
     focus(c, d, m);
 }
 
+/**
+ * copy the exposed area of a built-in bar from its pixmap
+ */
+void expose(XEvent *e) {
+    for (int cm = 0; cm < nmonitors; cm++) if (monitors[cm].bar && monitors[cm].bar == e->xexpose.window)
+        XCopyArea(dis, monitors[cm].buf, monitors[cm].bar, bargc, e->xexpose.x, e->xexpose.y,
+                  e->xexpose.width, e->xexpose.height, e->xexpose.x, e->xexpose.y);
+}
+
 /**
  * 1. set current/active/focused and previously focused client
  *    in other words, manage curr and prev references
  * 2. restack clients
  * 3. highlight borders and set active window property
  * 4. give input focus to the current/active/focused client
+ *
+ * requests are not synced with the server; errors on windows
+ * that were destroyed meanwhile are ignored by xerror()
  */
 void focus(Client *c, Desktop *d, Monitor *m) {
     /* update references to prev and curr,
@@ -596,6 +1211,10 @@ void focus(Client *c, Desktop *d, Monitor *m) {
         return;
     } else if (d->prev == c && d->curr != c->next) { d->prev = prevclient((d->curr = c), d);
     } else if (d->curr != c) { d->prev = d->curr; d->curr = c; }
+#ifdef PROFILE
+    Mark pm;
+    profmark(&pm);
+#endif
 
     /* restack clients
      *
@@ -609,13 +1228,18 @@ void focus(Client *c, Desktop *d, Monitor *m) {
      *  - tiled windows
      *
      * num of n:all fl:fullscreen ft:floating/transient windows
+     *
+     * only clients whose border or place in the stack changed
+     * are sent requests, and the desktop is only restacked
+     * if any client's place differs from the last restack.
      */
-    int n = 0, fl = 0, ft = 0;
+    int n = 0, fl = 0, ft = 0, i = 0;
     for (c = d->head; c; c = c->next, ++n) if (ISFFT(c)) { fl++; if (!c->isfull) ft++; }
-    Window w[n];
-    w[(d->curr->isfloat || d->curr->istrans) ? 0:ft] = d->curr->win;
+    Window w[n]; Bool restack = False;
+    int ci = (d->curr->isfloat || d->curr->istrans) ? 0:ft;
     for (fl += !ISFFT(d->curr) ? 1:0, c = d->head; c; c = c->next) {
-        XSetWindowBorder(dis, c->win, (c != d->curr) ? win_unfocus:(m == &monitors[currmonidx]) ? win_focus:win_infocus);
+        unsigned long bc = (c != d->curr) ? win_unfocus:(m == &monitors[currmonidx]) ? win_focus:win_infocus;
+        if (c->bc != bc) XSetWindowBorder(dis, c->win, c->bc = bc);
         /*
          * a window should have borders in any case, except if
          *  - the window is fullscreen
@@ -623,18 +1247,22 @@ void focus(Client *c, Desktop *d, Monitor *m) {
          *      - the mode is MONOCLE or,
          *      - it is the only window on screen
          */
-        XSetWindowBorderWidth(dis, c->win, c->isfull || (!ISFFT(c) &&
-            (d->mode == MONOCLE || !d->head->next)) ? 0:BORDER_WIDTH);
-        if (c != d->curr) w[c->isfull ? --fl:ISFFT(c) ? --ft:--n] = c->win;
+        setborder(c, c->isfull || (!ISFFT(c) && (d->mode == MONOCLE || !d->head->next)) ? 0:BORDER_WIDTH);
+        w[(i = (c == d->curr) ? ci:c->isfull ? --fl:ISFFT(c) ? --ft:--n)] = c->win;
+        if (c->pos != i) { c->pos = i; restack = True; }
         if (CLICK_TO_FOCUS || c == d->curr) grabbuttons(c);
     }
-    XRestackWindows(dis, w, LENGTH(w));
+    if (restack) XRestackWindows(dis, w, LENGTH(w));
 
     if (&m->desktops[m->currdeskidx] == d) XSetInputFocus(dis, d->curr->win, RevertToPointerRoot, CurrentTime);
     XChangeProperty(dis, root, netatoms[NET_ACTIVE], XA_WINDOW, 32,
                     PropModeReplace, (unsigned char *)&d->curr->win, 1);
-
-    XSync(dis, False);
+#ifdef DEBUG
+    stats.unsynced++;
+#endif
+#ifdef PROFILE
+    profend(PROF_FOCUS, &pm);
+#endif
 }
 
 /**
@@ -665,6 +1293,30 @@ void focusurgent(void) {
     if (c) { if (d != -1) change_desktop(&(Arg){.i = d}); focus(c, &m->desktops[m->currdeskidx], m); }
 }
 
+/**
+ * destroy the built-in bar of the monitor, to be created again when shown
+ *
+ * only done when the monitor changes or goes away, and on exit,
+ * a hidden panel only unmaps the bar (see updatebar)
+ */
+void freebar(Monitor *m) {
+    if (m->buf) XFreePixmap(dis, m->buf);
+    if (m->bar) XDestroyWindow(dis, m->bar);
+    m->bar = m->buf = None;
+    m->barmapped = False;
+}
+
+/**
+ * return the client to the pool for reuse
+ */
+void freeclient(Client *c) {
+    c->next = pool;
+    pool = c;
+#ifdef DEBUG
+    stats.clients--;
+#endif
+}
+
 /**
  * get a pixel with the requested color to
  * fill some window area (such as borders)
@@ -681,13 +1333,19 @@ unsigned long getcolor(const char* color, const int screen) {
  * the wm listens to those button bindings and
  * calls an appropriate handler when a binding
  * occurs (see buttonpress).
+ *
+ * the grabs only change when the client gains or
+ * loses focus, otherwise there is nothing to do.
  */
 void grabbuttons(Client *c) {
     Monitor *cm = &monitors[currmonidx];
     unsigned int b, m, modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+    int grab = (c != cm->desktops[cm->currdeskidx].curr);
+    if (c->grab == grab) return; else if (c->grab == -1) XUngrabButton(dis, AnyButton, AnyModifier, c->win);
+    c->grab = grab;
 
     for (m = 0; CLICK_TO_FOCUS && m < LENGTH(modifiers); m++)
-        if (c != cm->desktops[cm->currdeskidx].curr) XGrabButton(dis, FOCUS_BUTTON, modifiers[m],
+        if (grab) XGrabButton(dis, FOCUS_BUTTON, modifiers[m],
                 c->win, False, BUTTONMASK, GrabModeAsync, GrabModeAsync, None, None);
         else XUngrabButton(dis, FOCUS_BUTTON, modifiers[m], c->win);
 
@@ -702,45 +1360,163 @@ void grabbuttons(Client *c) {
  * the wm listens to those key bindings and
  * calls an appropriate handler when a binding
  * occurs (see keypressed).
+ *
+ * the numlock modifier and the keycodes of the keys depend
+ * on the keyboard mapping, so they are looked up here and
+ * the bindings table is rebuilt (see mappingnotify).
  */
 void grabkeys(void) {
     KeyCode code;
     XUngrabKey(dis, AnyKey, AnyModifier, root);
+
+    /* set numlockmask */
+    XModifierKeymap *modmap = XGetModifierMapping(dis);
+    for (int k = 0; k < 8; k++) for (int j = 0; j < modmap->max_keypermod; j++)
+        if (modmap->modifiermap[modmap->max_keypermod*k + j] == XKeysymToKeycode(dis, XK_Num_Lock))
+            numlockmask = (1 << k);
+    XFreeModifiermap(modmap);
+
     unsigned int k, m, modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+    memset(bindings, 0, sizeof(bindings));
+    for (k = 0; k < LENGTH(buttons); k++) addbinding(BINDCODE(buttons[k].button, buttons[k].mask) | BUTTONBIT, k);
 
-    for (k = 0, m = 0; k < LENGTH(keys); k++, m = 0)
-        while ((code = XKeysymToKeycode(dis, keys[k].keysym)) && m < LENGTH(modifiers))
+    for (k = 0, m = 0; k < LENGTH(keys); k++, m = 0) {
+        if ((code = XKeysymToKeycode(dis, keys[k].keysym))) addbinding(BINDCODE(code, keys[k].mod), k);
+        while (code && m < LENGTH(modifiers))
             XGrabKey(dis, code, keys[k].mod|modifiers[m++], root, True, GrabModeAsync, GrabModeAsync);
+    }
 }
 
 /**
  * grid mode / grid layout
  * arrange windows in a grid aka fair
  */
-void grid(int x, int y, int w, int h, const Desktop *d) {
-    int n = 0, cols = 0, cn = 0, rn = 0, i = -1;
-    for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) ++n;
+void grid(int x, int y, int w, int h, __attribute__((unused)) const Desktop *d, int n, Rect *r) {
+    int cols = 0, cn = 0, rn = 0;
     for (cols = 0; cols <= n/2; cols++) if (cols*cols >= n) break; /* emulate square root */
     if (n == 0) return; else if (n == 5) cols = 2;
 
-    int rows = n/cols, ch = h - BORDER_WIDTH, cw = (w - BORDER_WIDTH)/(cols ? cols:1);
-    for (Client *c = d->head; c; c = c->next) {
-        if (ISFFT(c)) continue; else ++i;
+    /* the pixels left over by the division are spread over the columns and rows */
+    int rows = n/cols;
+    w -= BORDER_WIDTH; h -= BORDER_WIDTH;
+    for (int i = 0; i < n; i++) {
         if (i/rows + 1 > cols - n%cols) rows = n/cols + 1;
-        MVRSZ(c, (x + cn*cw), (y + rn*ch/rows), (cw - BORDER_WIDTH), (ch/rows - BORDER_WIDTH));
+        r[i] = CELL(x + cn*w/cols, y + rn*h/rows, (cn + 1)*w/cols - cn*w/cols, (rn + 1)*h/rows - rn*h/rows);
         if (++rn >= rows) { rn = 0; cn++; }
     }
 }
 
+/**
+ * hide a client whose desktop is not shown
+ *
+ * the window is either moved off screen, or when UNMAP_HIDDEN
+ * is set, unmapped and marked iconic. the unmap notification
+ * this causes is counted, so that it is not taken as the
+ * window withdrawing itself (see unmapnotify).
+ */
+void hide(Client *c) {
+    if (!UNMAP_HIDDEN) { MV(c, c->x + off_x, c->y + off_y); return; }
+    if (c->ishide) return;
+    c->ishide = True; c->unmaps++;
+    XUnmapWindow(dis, c->win);
+    setwmstate(c->win, IconicState);
+}
+
+/**
+ * accept a connection on the command socket
+ *
+ * the connection does not block the event loop,
+ * and is dropped if all connection slots are taken
+ */
+void ipcaccept(void) {
+    int fd = accept(ipcfd, NULL, NULL);
+    if (fd < 0) return;
+    for (unsigned int i = 0; i < LENGTH(conns); i++) if (conns[i].fd < 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        conns[i].fd = fd; conns[i].len = 0;
+        return;
+    }
+    close(fd);
+}
+
+/**
+ * run a command or answer a query received on the command socket
+ *
+ * info   - the desktop info, as output by desktopinfo
+ * window - the id of the current window, 0 if there is none
+ */
+void ipccommand(int fd, char *line) {
+    Monitor *m = &monitors[currmonidx];
+    char name[32];
+    int n = 0;
+
+    if (sscanf(line, "%31s %d", name, &n) < 1) return;
+    if (!strcmp(name, "window")) {
+        Client *c = m->desktops[m->currdeskidx].curr;
+        ipcreply(fd, "0x%lx\n", c ? c->win:0);
+    } else if (!strcmp(name, "info")) {
+        for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+            Desktop *d = &(m = &monitors[cm])->desktops[cd];
+            ipcreply(fd, "%d:%d:%d:%d:%d:%d:%d ", cm, cm == currmonidx, cd,
+                     d->count, d->mode, cd == m->currdeskidx, d->urgn > 0);
+        }
+        ipcreply(fd, "\n");
+    } else {
+        for (unsigned int i = 0; i < LENGTH(commands); i++)
+            if (!strcmp(commands[i].name, name)) { PROF(PROF_COMMAND + i, commands[i].func(&(Arg){.i = n})); return; }
+        ipcreply(fd, "error: unknown command: %s\n", name);
+    }
+}
+
+/**
+ * read the input available on a connection to the command socket
+ * and run each complete line, close the connection on end of file
+ * or when a line does not fit in its buffer
+ */
+void ipcread(unsigned int i) {
+    ssize_t n = read(conns[i].fd, conns[i].buf + conns[i].len, sizeof(conns[i].buf) - 1 - conns[i].len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    conns[i].buf[(conns[i].len += n > 0 ? n:0)] = '\0';
+
+    char *line = conns[i].buf;
+    for (char *nl = NULL; (nl = strchr(line, '\n')); line = nl + 1) {
+        *nl = '\0';
+        ipccommand(conns[i].fd, line);
+    }
+    if (n <= 0 && *line) ipccommand(conns[i].fd, line); /* unterminated last line */
+    memmove(conns[i].buf, line, (conns[i].len -= line - conns[i].buf) + 1);
+
+    if (n > 0 && conns[i].len < sizeof(conns[i].buf) - 1) return;
+    close(conns[i].fd);
+    conns[i].fd = -1;
+}
+
+/**
+ * send a formatted reply on a connection to the command socket
+ *
+ * the connection never blocks, so replies
+ * are dropped if the peer does not read them
+ */
+void ipcreply(int fd, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) send(fd, buf, (size_t)n < sizeof(buf) ? (size_t)n:sizeof(buf) - 1, MSG_NOSIGNAL);
+}
+
 /**
  * on the press of a key binding (see grabkeys)
  * call the appropriate handler
  */
 void keypress(XEvent *e) {
-    KeySym keysym = XkbKeycodeToKeysym(dis, e->xkey.keycode, 0, 0);
-    for (unsigned int i = 0; i < LENGTH(keys); i++)
-        if (keysym == keys[i].keysym && CLEANMASK(keys[i].mod) == CLEANMASK(e->xkey.state))
-            if (keys[i].func) keys[i].func(&keys[i].arg);
+    unsigned int code = BINDCODE(e->xkey.keycode, e->xkey.state);
+    for (unsigned int s = BINDHASH(code), i = 0; bindings[s].code; s = (s + 1) % LENGTH(bindings))
+        if (bindings[s].code == code && keys[(i = bindings[s].idx)].func)
+            PROF(profslot(keys[i].func), keys[i].func(&keys[i].arg));
 }
 
 /**
@@ -769,55 +1545,153 @@ void last_desktop(void) {
 }
 
 /**
- * a map request is received when a window wants to display itself.
+ * manage a window, once the requests about it were sent (see query)
+ *
  * if the window has override_redirect flag set,
  * then it should not be handled by the wm.
- * if the window already has a client then there is nothing to do.
  *
- * match window class and/or install name against an app rule.
+ * match window class and/or install name, role or title against an app rule.
  * create a new client for the window and add it to the appropriate desktop.
  * set the floating, transient and fullscreen state of the client.
  * if the desktop in which the window is to be spawned is the current desktop
  * then display/map the window, else, if follow is set, focus the new desktop.
- */
-void maprequest(XEvent *e) {
-    Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
-    Window w = e->xmaprequest.window;
-    XWindowAttributes wa = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    if (wintoclient(w, &c, &d, &m) || (XGetWindowAttributes(dis, w, &wa) && wa.override_redirect)) return;
+ *
+ * a window adopted on restart has the state it was saved with (see savestate)
+ * which is used instead of the app rules. adopted windows are only recorded
+ * as the current client of their desktop, and are placed and focused once
+ * they all are (see scan).
+ */
+void manage(Window w, const Query *q, const long *saved) {
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    xcb_get_window_attributes_reply_t *wa = xcb_get_window_attributes_reply(xc, q->ac, NULL);
+    xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(xc, q->gc, NULL);
+    xcb_get_property_reply_t *cr = xcb_get_property_reply(xc, q->cc, NULL),
+                             *tr = xcb_get_property_reply(xc, q->tc, NULL),
+                             *sr = xcb_get_property_reply(xc, q->sc, NULL),
+                             *rr = hasrules[RULE_ROLE] ? xcb_get_property_reply(xc, q->rc, NULL):NULL,
+                             *nr = hasrules[RULE_TITLE] ? xcb_get_property_reply(xc, q->nc, NULL):NULL,
+                             *wr = hasrules[RULE_TITLE] ? xcb_get_property_reply(xc, q->wc, NULL):NULL;
+#ifdef PROFILE
+    trips++; /* the replies were all waited for at once */
+#endif
+    char ch[257] = {0}, role[257] = {0}, title[257] = {0}; /* instance and class names are separated by a NUL */
+    Bool managed = wa && g && !wa->override_redirect, viewable = wa && wa->map_state == XCB_MAP_STATE_VIEWABLE;
+    int len = copyprop(cr, ch, sizeof(ch));
+    copyprop(rr, role, sizeof(role));
+    if (!copyprop(nr, title, sizeof(title))) copyprop(wr, title, sizeof(title));
+    free(wa); free(cr); free(rr); free(nr); free(wr);
+    if (!managed) { free(g); free(tr); free(sr); return; }
 
-    XClassHint ch = {0, 0};
     Bool follow = False, floating = False, fullscrn = False;
     int newmon = currmonidx, newdsk = monitors[currmonidx].currdeskidx;
+    unsigned int r = LENGTH(rules);
+
+    /* the class follows the instance only if it was not cut off */
+    size_t il = strnlen(ch, sizeof(ch) - 1);
+    if (len > 0 && il + 1 < (size_t)len && il + 1 < sizeof(ch) - 1) r = matchrule(RULE_CLASS, ch + il + 1, r);
+    if (len > 0) r = matchrule(RULE_CLASS, ch, r);
+    if (hasrules[RULE_ROLE]) r = matchrule(RULE_ROLE, role, r);
+    if (hasrules[RULE_TITLE]) r = matchrule(RULE_TITLE, title, r);
+    if (saved) {
+        /* a monitor that is gone falls back to the last one, a negative index is ignored */
+        if (saved[1] >= 0) newmon = saved[1] < nmonitors ? saved[1]:nmonitors - 1;
+        if (saved[2] >= 0) newdsk = saved[2] < DESKTOPS ? saved[2]:DESKTOPS - 1;
+        floating = saved[3] & STATE_FLOAT, fullscrn = saved[3] & STATE_FULL;
+    } else if (r < LENGTH(rules)) {
+        if (rules[r].monitor >= 0 && rules[r].monitor < nmonitors) newmon = rules[r].monitor;
+        if (rules[r].desktop >= 0 && rules[r].desktop < DESKTOPS) newdsk = rules[r].desktop;
+        follow = rules[r].follow, floating = rules[r].floating, fullscrn = rules[r].fullscrn;
+    }
 
-    if (XGetClassHint(dis, w, &ch)) for (unsigned int i = 0; i < LENGTH(rules); i++)
-        if (strstr(ch.res_class, rules[i].class) || strstr(ch.res_name, rules[i].class)) {
-            if (rules[i].monitor >= 0 && rules[i].monitor < nmonitors) newmon = rules[i].monitor;
-            if (rules[i].desktop >= 0 && rules[i].desktop < DESKTOPS) newdsk = rules[i].desktop;
-            follow = rules[i].follow, floating = rules[i].floating, fullscrn = rules[i].fullscrn;
-            break;
-        }
-    if (ch.res_class) XFree(ch.res_class);
-    if (ch.res_name) XFree(ch.res_name);
-
-    c = addwindow(w, (d = &(m = &monitors[newmon])->desktops[newdsk])); /* from now on, use c->win */
+    Monitor *m = &monitors[newmon]; Desktop *d = &m->desktops[newdsk];
+    Client *c = addwindow(w, newmon, newdsk); /* from now on, use c->win */
     c->isfull = fullscrn;
-    c->istrans = XGetTransientForHint(dis, c->win, &w);
-    if ((c->isfloat = (floating || d->mode == FLOAT)) && !c->istrans)
-        MV(c, m->x + (m->w - wa.width)/2, m->y + (m->h - wa.height)/2);
-
-    int i; unsigned long l; unsigned char *state = NULL; Atom a;
-    if (XGetWindowProperty(dis, c->win, netatoms[NET_WM_STATE], 0L, sizeof a,
-                False, XA_ATOM, &a, &i, &l, &l, &state) == Success && state)
-        setfullscreen(c, d, m, (*(Atom *)state == netatoms[NET_FULLSCREEN]));
-    if (state) XFree(state);
-
-    if (m->currdeskidx != newdsk) MV(c, c->x + off_x, c->y + off_y); else if (!ISFFT(c)) tile(d, m);
+    c->istrans = tr && tr->type == XA_WINDOW && xcb_get_property_value_length(tr) > 0;
+    c->isfloat = floating || d->mode == FLOAT;
+    if (saved && (c->isfloat || c->istrans)) MV(c, saved[4], saved[5]);
+    else if (c->isfloat && !c->istrans) MV(c, m->x + (m->w - g->width)/2, m->y + (m->h - g->height)/2);
+
+    if (sr && sr->type == XA_ATOM && xcb_get_property_value_length(sr) >= (int)sizeof(xcb_atom_t))
+        setfullscreen(c, d, m, (*(xcb_atom_t *)xcb_get_property_value(sr) == netatoms[NET_FULLSCREEN]));
+    free(g); free(tr); free(sr);
+
+    if (m->currdeskidx == newdsk) { if (!ISFFT(c)) tile(d, m); }
+    else if (UNMAP_HIDDEN && !viewable) { c->ishide = True; setwmstate(c->win, IconicState); } /* mapped once shown */
+    else hide(c);
     if (follow) { change_monitor(&(Arg){.i = newmon}); change_desktop(&(Arg){.i = newdsk}); }
-    XMapWindow(dis, c->win);
-    focus(c, d, m);
+    if (!adopting) retile(); /* place the window before it is shown */
+    if (!c->ishide) XMapWindow(dis, c->win);
+    if (UNMAP_HIDDEN && !c->ishide) setwmstate(c->win, NormalState);
+    if (!adopting) focus(c, d, m);
+    else if (d->curr != c) { d->prev = d->curr; d->curr = c; }
+
+    dirtyinfo = True;
+}
+
+/**
+ * the keyboard or modifier mapping changed
+ *
+ * update the key grabs and bindings for the new keycodes,
+ * and the button grabs of all clients, as numlock may have moved
+ */
+void mappingnotify(XEvent *e) {
+    XMappingEvent *ev = &e->xmapping;
+    XRefreshKeyboardMapping(ev);
+    if (ev->request != MappingKeyboard && ev->request != MappingModifier) return;
+    grabkeys();
+
+    for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++)
+        for (Client *c = monitors[cm].desktops[cd].head; c; c = c->next)
+            if (c->grab != -1) { c->grab = -1; grabbuttons(c); }
+}
+
+/**
+ * a map request is received when a window wants to display itself.
+ * if the window already has a client then there is nothing to do.
+ *
+ * the window's attributes and properties are requested all at once
+ * through the xcb connection underlying xlib, and the replies are
+ * collected together, instead of a round trip for each of them.
+ */
+void maprequest(XEvent *e) {
+    Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
+    Window w = e->xmaprequest.window;
+    if (wintoclient(w, &c, &d, &m)) return;
+#ifdef DEBUG
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+#endif
+    Query q;
+    query(w, &q);
+    manage(w, &q, NULL);
+#ifdef DEBUG
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    warnx("maprequest: window 0x%lx managed in %ld us", w,
+          (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L);
+#endif
+}
 
-    if (!follow) desktopinfo();
+
+/**
+ * find the first app rule before rule r that matches the given
+ * string of property p, otherwise return r
+ *
+ * with few rules each pattern is tried in turn, otherwise the
+ * property's automaton is walked along the string, each state
+ * knowing the first rule ending on it or on any of its suffixes
+ */
+unsigned int matchrule(int p, const char *s, unsigned int r) {
+    if (!states) {
+        for (unsigned int i = 0; i < r; i++) if (patterns[i].p == p && strstr(s, patterns[i].s)) return i;
+        return r;
+    }
+    unsigned int t = roots[p];
+    if (states[t].rule < r) r = states[t].rule;
+    for (const unsigned char *ch = (const unsigned char *)s; *ch; ch++) {
+        t = moves[(size_t)t * nclasses + byteclass[*ch]];
+        if (states[t].rule < r) r = states[t].rule;
+    }
+    return r;
 }
 
 /**
@@ -831,7 +1705,14 @@ void maprequest(XEvent *e) {
  * on on pointer movement resize or move the window under the curson.
  * also handle map requests and configure requests.
  *
- * finally, on ButtonRelease, ungrab the poitner.
+ * pending motion events are drained so only the latest pointer position
+ * is used, and the window geometry is updated at most MOTION_RATE times
+ * per second. a motion held back by that limit is applied once no other
+ * event arrives within the rest of the interval, so the window does not
+ * stop short of the pointer. the size honors the window's size hints,
+ * which are read once when the drag starts.
+ *
+ * finally, on ButtonRelease, apply the last position and ungrab the poitner.
  * event handling is passed back to run() function.
  *
  * once a window has been moved or resized, it's marked as floating.
@@ -839,10 +1720,23 @@ void maprequest(XEvent *e) {
 void mousemotion(const Arg *arg) {
     Monitor *m = &monitors[currmonidx]; Desktop *d = &m->desktops[m->currdeskidx];
     XWindowAttributes wa;
+    XSizeHints hints;
     XEvent ev;
+    long supplied;
 
     if (!d->curr || !XGetWindowAttributes(dis, d->curr->win, &wa)) return;
 
+    int minw = MINWSZ, minh = MINWSZ, basew = 0, baseh = 0, incw = 1, inch = 1;
+    if (arg->i == RESIZE && XGetWMNormalHints(dis, d->curr->win, &hints, &supplied)) {
+        if (hints.flags & PBaseSize) { basew = hints.base_width; baseh = hints.base_height; }
+        else if (hints.flags & PMinSize) { basew = hints.min_width; baseh = hints.min_height; }
+        if (hints.flags & PMinSize && hints.min_width  > minw) minw = hints.min_width;
+        if (hints.flags & PMinSize && hints.min_height > minh) minh = hints.min_height;
+        if (hints.flags & PResizeInc && hints.width_inc > 0 && hints.height_inc > 0) {
+            incw = hints.width_inc; inch = hints.height_inc;
+        }
+    }
+
     if (arg->i == RESIZE) XWarpPointer(dis, d->curr->win, d->curr->win, 0, 0, 0, 0, --wa.width, --wa.height);
     int rx, ry, c, xw, yh; unsigned int v; Window w;
     if (!XQueryPointer(dis, root, &w, &w, &rx, &ry, &c, &c, &v) || w != d->curr->win) return;
@@ -852,16 +1746,47 @@ void mousemotion(const Arg *arg) {
 
     if (!d->curr->isfloat && !d->curr->istrans) { d->curr->isfloat = True; tile(d, m); focus(d->curr, d, m); }
     XRaiseWindow(dis, d->curr->win);
+    d->curr->pos = -1;
+    retile(); /* no batch ends until the pointer is released */
 
+    Time last = 0, now = 0; Bool pending = False, idle;
+    int px = rx, py = ry, fd = ConnectionNumber(dis);
+    const long mask = BUTTONMASK|PointerMotionMask|SubstructureRedirectMask;
     do {
-        XMaskEvent(dis, BUTTONMASK|PointerMotionMask|SubstructureRedirectMask, &ev);
-        if (ev.type == MotionNotify) {
-            xw = (arg->i == MOVE ? wa.x:wa.width)  + ev.xmotion.x - rx;
-            yh = (arg->i == MOVE ? wa.y:wa.height) + ev.xmotion.y - ry;
-            if (arg->i == RESIZE) XResizeWindow(dis, d->curr->win,
-                    xw > MINWSZ ? xw:wa.width, yh > MINWSZ ? yh:wa.height);
-            else if (arg->i == MOVE) MV(d->curr, xw, yh);
+        /* a throttled motion is applied as soon as no event follows it in time */
+        idle = False;
+        if (!pending) XMaskEvent(dis, mask, &ev);
+        else if (!XCheckMaskEvent(dis, mask, &ev)) {
+            long wait = MOTION_RATE ? 1000/MOTION_RATE - (long)(now - last) : 0;
+            struct timeval tv = { 0, wait > 0 ? wait*1000 : 0 };
+            fd_set fds; FD_ZERO(&fds); FD_SET(fd, &fds);
+            idle = select(fd + 1, &fds, NULL, NULL, &tv) <= 0 || !XCheckMaskEvent(dis, mask, &ev);
+        }
+        if (idle) { ev.type = MotionNotify; last = now; }
+        else if (ev.type == MotionNotify) {
+            do {
+#ifdef DEBUG
+                stats.motions++;
+#endif
+                px = ev.xmotion.x; py = ev.xmotion.y; pending = True;
+            } while (XCheckMaskEvent(dis, PointerMotionMask, &ev));
+            now = ev.xmotion.time;
+            if (MOTION_RATE && now - last < 1000/MOTION_RATE) continue;
+            last = now;
         } else if (ev.type == ConfigureRequest || ev.type == MapRequest) events[ev.type](&ev);
+        if (!pending || (ev.type != MotionNotify && ev.type != ButtonRelease)) continue;
+
+        pending = False;
+        xw = (arg->i == MOVE ? wa.x:wa.width)  + px - rx;
+        yh = (arg->i == MOVE ? wa.y:wa.height) + py - ry;
+#ifdef DEBUG
+        stats.drags++;
+#endif
+        if (arg->i == MOVE) { MV(d->curr, xw, yh); continue; }
+        xw = basew + (xw - basew)/incw*incw; yh = baseh + (yh - baseh)/inch*inch;
+        if (xw < minw) xw = wa.width;
+        if (yh < minh) yh = wa.height;
+        if (xw != d->curr->w || yh != d->curr->h) XResizeWindow(dis, d->curr->win, d->curr->w = xw, d->curr->h = yh);
     } while (ev.type != ButtonRelease);
 
     XUngrabPointer(dis, CurrentTime);
@@ -871,87 +1796,45 @@ void mousemotion(const Arg *arg) {
  * monocle aka max aka fullscreen mode/layout
  * each window should cover all the available screen space
  */
-void monocle(int x, int y, int w, int h, const Desktop *d) {
-    for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) MVRSZ(c, x, y, w, h);
+void monocle(int x, int y, int w, int h, __attribute__((unused)) const Desktop *d, int n, Rect *r) {
+    for (int i = 0; i < n; i++) r[i] = (Rect){ x, y, w, h };
 }
 
 /**
  * swap positions of current and next from current clients
+ * if current is the last client, it becomes the head
  */
 void move_down(void) {
     Desktop *d = &monitors[currmonidx].desktops[monitors[currmonidx].currdeskidx];
     if (!d->curr || !d->head->next) return;
-    /* p is previous, c is current, n is next, if current is head n is last */
-    Client *p = prevclient(d->curr, d), *n = (d->curr->next) ? d->curr->next:d->head;
-    /*
-     * if c is head, swapping with n should update head to n
-     * [c]->[n]->..  ==>  [n]->[c]->..
-     *  ^head              ^head
-     *
-     * else there is a previous client and p->next should be what's after c
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     */
-    if (d->curr == d->head) d->head = n; else p->next = d->curr->next;
-    /*
-     * if c is the last client, c will be the current head
-     * [n]->..->[p]->[c]->NULL  ==>  [c]->[n]->..->[p]->NULL
-     *  ^head                         ^head
-     * else c will take the place of n, so c-next will be n->next
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     */
-    d->curr->next = (d->curr->next) ? n->next:n;
     /*
-     * if c was swapped with n then they now point to the same ->next. n->next should be c
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     *                                        [c]-^
+     * ..->[c]->[n]->[nn]->..  ==>  ..->[n]->[c]->[nn]->..
      *
-     * else c is the last client and n is head,
-     * so c will be move to be head, no need to update n->next
-     * [n]->..->[p]->[c]->NULL  ==>  [c]->[n]->..->[p]->NULL
+     * [h]->..->[p]->[c]->NULL  ==>  [c]->[h]->..->[p]->NULL
      *  ^head                         ^head
      */
-    if (d->curr->next == n->next) n->next = d->curr; else d->head = d->curr;
+    Client *n = d->curr->next;
+    detach(d->curr, d);
+    attach(d->curr, n ? n->next:d->head, d);
     if (!d->curr->isfloat && !d->curr->istrans) tile(d, &monitors[currmonidx]);
 }
 
 /**
  * swap positions of current and previous from current clients
+ * if current is the head, it becomes the last client
  */
 void move_up(void) {
     Desktop *d = &monitors[currmonidx].desktops[monitors[currmonidx].currdeskidx];
     if (!d->curr || !d->head->next) return;
-    /* p is previous from current or last if current is head */
-    Client *pp = NULL, *p = prevclient(d->curr, d);
-    /* pp is previous from p, or null if current is head and thus p is last */
-    if (p->next) for (pp = d->head; pp && pp->next != p; pp = pp->next);
     /*
-     * if p has a previous client then the next client should be current (current is c)
-     * ..->[pp]->[p]->[c]->..  ==>  ..->[pp]->[c]->[p]->..
+     * ..->[p]->[c]->[n]->..  ==>  ..->[c]->[p]->[n]->..
      *
-     * if p doesn't have a previous client, then p might be head, so head must change to c
-     * [p]->[c]->..  ==>  [c]->[p]->..
-     *  ^head              ^head
-     * if p is not head, then c is head (and p is last), so the new head is next of c
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
-     */
-    if (pp) pp->next = d->curr; else d->head = (d->curr == d->head) ? d->curr->next:d->curr;
-    /*
-     * next of p should be next of c
-     * ..->[pp]->[p]->[c]->[n]->..  ==>  ..->[pp]->[c]->[p]->[n]->..
-     * except if c was head (now c->next is head), so next of p should be c
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
-     */
-    p->next = (d->curr->next == d->head) ? d->curr:d->curr->next;
-    /*
-     * next of c should be p
-     * ..->[pp]->[p]->[c]->[n]->..  ==>  ..->[pp]->[c]->[p]->[n]->..
-     * except if c was head (now c->next is head), so c is must be last
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
+     * [c]->[n]->..->[l]->NULL  ==>  [n]->..->[l]->[c]->NULL
+     *  ^head                         ^head
      */
-    d->curr->next = (d->curr->next == d->head) ? NULL:p;
+    Client *p = (d->curr == d->head) ? NULL:d->curr->prev;
+    detach(d->curr, d);
+    attach(d->curr, p, d);
     if (!d->curr->isfloat && !d->curr->istrans) tile(d, &monitors[currmonidx]);
 }
 
@@ -964,10 +1847,35 @@ void moveresize(const Arg *arg) {
     if (!d->curr || !XGetWindowAttributes(dis, d->curr->win, &wa)) return;
     if (!d->curr->isfloat && !d->curr->istrans) { d->curr->isfloat = True; tile(d, m); focus(d->curr, d, m); }
     XRaiseWindow(dis, d->curr->win);
-    MVRSZ(d->curr, wa.x + ((int *)arg->v)[0], wa.y + ((int *)arg->v)[1],
+    d->curr->pos = -1;
+    resize(d->curr, wa.x + ((int *)arg->v)[0], wa.y + ((int *)arg->v)[1],
           wa.width + ((int *)arg->v)[2], wa.height + ((int *)arg->v)[3]);
 }
 
+/**
+ * get a zeroed client from the pool
+ * if the pool is empty, allocate a new chunk of clients for it
+ */
+Client* newclient(void) {
+    if (!pool) {
+        Chunk *k = NULL;
+        if (!(k = (Chunk *)calloc(1, sizeof(Chunk)))) err(EXIT_FAILURE, "cannot allocate clients");
+        k->next = chunks; chunks = k;
+        for (int i = LENGTH(k->c) - 1; i >= 0; i--) freeclient(&k->c[i]);
+#ifdef DEBUG
+        stats.clients += LENGTH(k->c);
+        stats.nchunks++;
+#endif
+    }
+    Client *c = pool;
+    pool = c->next;
+    memset(c, 0, sizeof(Client));
+#ifdef DEBUG
+    if (++stats.clients > stats.highwater) stats.highwater = stats.clients;
+#endif
+    return c;
+}
+
 /**
  * cyclic focus the next window
  * if the window is the last on stack, focus head
@@ -979,12 +1887,11 @@ void next_win(void) {
 
 /**
  * get the previous client from the given
+ * if the given client is the head, that is the last client
  * if no such client, return NULL
  */
 Client* prevclient(Client *c, Desktop *d) {
-    Client *p = NULL;
-    if (c && d->head && d->head->next) for (p = d->head; p->next && p->next != c; p = p->next);
-    return p;
+    return (c && d->head && d->head->next) ? c->prev:NULL;
 }
 
 /**
@@ -996,6 +1903,185 @@ void prev_win(void) {
     if (d->curr && d->head->next) focus(prevclient(d->curr, d), d, &monitors[currmonidx]);
 }
 
+#ifdef PROFILE
+/**
+ * called by xlib after each request it sends
+ *
+ * a request is taken to have been a round trip when the server
+ * is known to have processed every request sent so far, and it
+ * was not known before the request, as only waiting for a reply
+ * or an event can let xlib know that
+ */
+int profafter(Display *dis) {
+    unsigned long last = LastKnownRequestProcessed(dis);
+    if (last != lastknown && last == NextRequest(dis) - 1) trips++;
+    lastknown = last;
+    return 0;
+}
+
+/**
+ * log the name of an atom, or None, asking with xcb so that an atom
+ * that does not exist is not an error
+ */
+void profatom(Atom a) {
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    xcb_get_atom_name_reply_t *r = a ? xcb_get_atom_name_reply(xc, xcb_get_atom_name(xc, a), NULL):NULL;
+    if (r) fprintf(evlog, " %.*s", xcb_get_atom_name_name_length(r), xcb_get_atom_name_name(r));
+    else fprintf(evlog, " None");
+    free(r);
+}
+
+/**
+ * account the time, requests, bytes and round trips since the mark to slot s
+ *
+ * requests are counted by the sequence numbers, so those sent
+ * with xcb are counted once xlib sends a request of its own
+ */
+void profend(unsigned int s, const Mark *pm) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    unsigned long us = (t.tv_sec - pm->t.tv_sec) * 1000000L + (t.tv_nsec - pm->t.tv_nsec) / 1000L;
+    unsigned int b = 0;
+    while (b < LENGTH(prof[s].hist) - 1 && us >> b) b++;
+    prof[s].calls++; prof[s].hist[b]++; prof[s].usec += us;
+    if (us > prof[s].max) prof[s].max = us;
+    prof[s].requests += (lastreqs = NextRequest(dis) - pm->req);
+    prof[s].bytes += (lastbytes = profflush() - pm->out);
+    prof[s].trips += trips - pm->rt;
+    lastusec = us;
+}
+
+/**
+ * send the requests buffered by xlib and xcb, and return the bytes
+ * written to the server so far
+ *
+ * both buffer what is sent until they flush, so the bytes of a call
+ * are only known once it is flushed. this makes a profile build write
+ * after each profiled call, where others write once per event batch
+ */
+uint64_t profflush(void) {
+    XFlush(dis);
+    xcb_flush(XGetXCBConnection(dis));
+    return xcb_total_written(XGetXCBConnection(dis));
+}
+
+/**
+ * append a handled event to the event log, set with MONSTERWM_EVENTLOG
+ *
+ * each line holds the microseconds since the wm started, the time
+ * spent handling the event, the requests and bytes sent for it, the
+ * name of the event, the window it is about and the fields the handler
+ * reads. atoms are logged by name and keys with their symbol too, and
+ * a mapped window with its geometry, transient and names, so that the
+ * log can be replayed on another server (see tests/replay.c)
+ */
+void proflog(const XEvent *e) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    fprintf(evlog, "%ld %lu %lu %lu %s", (t.tv_sec - evstart.tv_sec) * 1000000L + (t.tv_nsec - evstart.tv_nsec) / 1000L,
+            lastusec, lastreqs, lastbytes, profnames[e->type]);
+    switch (e->type) {
+        case KeyPress: {
+            const char *sym = XKeysymToString(XkbKeycodeToKeysym(dis, e->xkey.keycode, 0, 0));
+            fprintf(evlog, " 0x%lx %u %u %s", e->xkey.window, e->xkey.keycode, e->xkey.state, sym ? sym:"NoSymbol");
+        } break;
+        case ButtonPress:      fprintf(evlog, " 0x%lx %u %u", e->xbutton.subwindow, e->xbutton.button, e->xbutton.state); break;
+        case EnterNotify:      fprintf(evlog, " 0x%lx %d %d", e->xcrossing.window, e->xcrossing.mode, e->xcrossing.detail); break;
+        case MapRequest:       profwindow(e->xmaprequest.window); break;
+        case DestroyNotify:    fprintf(evlog, " 0x%lx", e->xdestroywindow.window); break;
+        case UnmapNotify: { /* the wm's own unmaps leave the client managed */
+            Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
+            fprintf(evlog, " 0x%lx %d %d", e->xunmap.window, e->xunmap.send_event, wintoclient(e->xunmap.window, &c, &d, &m));
+        } break;
+        case PropertyNotify: {
+            XWMHints *wmh = e->xproperty.atom == XA_WM_HINTS ? XGetWMHints(dis, e->xproperty.window):NULL;
+            fprintf(evlog, " 0x%lx", e->xproperty.window);
+            profatom(e->xproperty.atom);
+            fprintf(evlog, " %d", wmh && (wmh->flags & XUrgencyHint));
+            if (wmh) XFree(wmh);
+        } break;
+        case ConfigureRequest: fprintf(evlog, " 0x%lx %d %d %d %d %lu %d %d", e->xconfigurerequest.window,
+                                       e->xconfigurerequest.x, e->xconfigurerequest.y, e->xconfigurerequest.width,
+                                       e->xconfigurerequest.height, e->xconfigurerequest.value_mask,
+                                       e->xconfigurerequest.border_width, e->xconfigurerequest.detail); break;
+        case ConfigureNotify:  fprintf(evlog, " 0x%lx %d %d %d %d", e->xconfigure.window, e->xconfigure.x,
+                                       e->xconfigure.y, e->xconfigure.width, e->xconfigure.height); break;
+        case ClientMessage: {
+            Bool state = e->xclient.message_type == netatoms[NET_WM_STATE];
+            fprintf(evlog, " 0x%lx", e->xclient.window);
+            profatom(e->xclient.message_type);
+            fprintf(evlog, " %ld", e->xclient.data.l[0]);
+            for (int i = 1; i < 3; i++) if (state) profatom(e->xclient.data.l[i]); else fprintf(evlog, " %ld", e->xclient.data.l[i]);
+        } break;
+        default:               fprintf(evlog, " 0x%lx", e->xany.window); break;
+    }
+    fputc('\n', evlog);
+}
+
+/**
+ * mark the start of a profiled call
+ */
+void profmark(Mark *pm) {
+    pm->out = profflush();
+    clock_gettime(CLOCK_MONOTONIC, &pm->t);
+    pm->req = NextRequest(dis);
+    pm->rt = trips;
+    lastknown = LastKnownRequestProcessed(dis);
+}
+
+/**
+ * print the profile of each slot that was entered to stderr,
+ * on exit and whenever SIGUSR1 is received
+ */
+void profreport(void) {
+    for (unsigned int s = 0; s < LENGTH(prof); s++) if (prof[s].calls) {
+        const char *name = s < PROF_COMMAND ? profnames[s]:s - PROF_COMMAND < LENGTH(commands) ? commands[s - PROF_COMMAND].name:"other";
+        fprintf(stderr, "profile: %-18s %8lu calls %10lu us %8lu max %8lu requests %10lu bytes %8lu round trips\n",
+                name ? name:"event", prof[s].calls, prof[s].usec, prof[s].max, prof[s].requests, prof[s].bytes, prof[s].trips);
+        fprintf(stderr, "profile: %-18s", "");
+        for (unsigned int b = 0; b < LENGTH(prof[s].hist); b++)
+            if (prof[s].hist[b]) fprintf(stderr, " %s%luus:%lu", b + 1 < LENGTH(prof[s].hist) ? "<":">=", 1ul << (b + 1 < LENGTH(prof[s].hist) ? b:b - 1), prof[s].hist[b]);
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * the profile slot of a function that can be bound to a key or button
+ */
+unsigned int profslot(void (*func)(const Arg *)) {
+    unsigned int i = 0;
+    while (i < LENGTH(commands) && commands[i].func != func) i++;
+    return PROF_COMMAND + i;
+}
+
+/**
+ * log a mapped window, with its geometry, the window it is transient
+ * for, and its instance, class and title names each after a tab
+ *
+ * the window may be gone, so the replies are waited for with xcb,
+ * where errors do not reach the error handler
+ */
+void profwindow(Window w) {
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(xc, xcb_get_geometry(xc, w), NULL);
+    xcb_get_property_reply_t *tr = xcb_get_property_reply(xc, xcb_get_property(xc, False, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1), NULL),
+                             *cr = xcb_get_property_reply(xc, xcb_get_property(xc, False, w, XA_WM_CLASS, XA_STRING, 0, 64), NULL),
+                             *nr = xcb_get_property_reply(xc, xcb_get_property(xc, False, w, XA_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 64), NULL);
+    char ch[257] = {0}, title[257] = {0};
+    int len = copyprop(cr, ch, sizeof(ch));
+    copyprop(nr, title, sizeof(title));
+    size_t il = strnlen(ch, sizeof(ch) - 1);
+    char *class = len > 0 && il + 1 < (size_t)len && il + 1 < sizeof(ch) - 1 ? ch + il + 1:"";
+    for (size_t i = 0; i < sizeof(ch); i++) if (ch[i] == '\t' || ch[i] == '\n') ch[i] = ' ';
+    for (size_t i = 0; i < sizeof(title); i++) if (title[i] == '\t' || title[i] == '\n') title[i] = ' ';
+
+    fprintf(evlog, " 0x%lx %d %d %d %d 0x%lx\t%s\t%s\t%s", w, g ? g->x:0, g ? g->y:0, g ? g->width:0, g ? g->height:0,
+            tr && xcb_get_property_value_length(tr) >= 4 ? (unsigned long)*(xcb_window_t *)xcb_get_property_value(tr):0,
+            ch, class, title);
+    free(g); free(tr); free(cr); free(nr);
+}
+#endif
+
 /**
  * set unrgent hint for a window
  */
@@ -1005,10 +2091,30 @@ void propertynotify(XEvent *e) {
 
     XWMHints *wmh = XGetWMHints(dis, c->win);
     Desktop *cd = &monitors[currmonidx].desktops[monitors[currmonidx].currdeskidx];
-    c->isurgn = (c != cd->curr && wmh && (wmh->flags & XUrgencyHint));
+    Bool urgn = (c != cd->curr && wmh && (wmh->flags & XUrgencyHint));
+    d->urgn += urgn - c->isurgn; c->isurgn = urgn;
 
     if (wmh) XFree(wmh);
-    desktopinfo();
+    dirtyinfo = True;
+}
+
+/**
+ * send the requests about a window that is to be managed,
+ * without waiting on their replies (see manage)
+ */
+void query(Window w, Query *q) {
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    q->ac = xcb_get_window_attributes(xc, w);
+    q->gc = xcb_get_geometry(xc, w);
+    q->cc = xcb_get_property(xc, False, w, XA_WM_CLASS, XA_STRING, 0, 64);
+    q->tc = xcb_get_property(xc, False, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+    q->sc = xcb_get_property(xc, False, w, netatoms[NET_WM_STATE], XA_ATOM, 0, 1);
+    /* the role and title are only needed if any app rule matches them */
+    if (hasrules[RULE_ROLE]) q->rc = xcb_get_property(xc, False, w, wmatoms[WM_ROLE], XA_STRING, 0, 64);
+    if (hasrules[RULE_TITLE]) {
+        q->nc = xcb_get_property(xc, False, w, netatoms[NET_WM_NAME], wmatoms[UTF8_STRING], 0, 64);
+        q->wc = xcb_get_property(xc, False, w, XA_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 64);
+    }
 }
 
 /**
@@ -1020,6 +2126,41 @@ void quit(const Arg *arg) {
     running = False;
 }
 
+/**
+ * the outputs or their crtcs changed, which moves or resizes the
+ * monitors without always resizing the root window, as when two
+ * monitors swap places, so update the monitors at the end of the
+ * event batch, once however many outputs changed
+ */
+void randrnotify(XEvent *e) {
+    XRRUpdateConfiguration(e);
+    dirtygeom = True;
+}
+
+/**
+ * read the status text of the built-in bar from the status fifo
+ *
+ * the status is the last whole line read, a line
+ * too long for the buffer is dropped
+ */
+void readstatus(void) {
+    ssize_t n = 0;
+    char *last = NULL, *line = statusbuf;
+    while ((n = read(statusfd, statusbuf + statuslen, sizeof(statusbuf) - 1 - statuslen)) > 0) {
+        statusbuf[statuslen += n] = '\0';
+        for (char *nl = NULL; (nl = strchr(line, '\n')); line = nl + 1, statusskip = False) {
+            *nl = '\0';
+            if (!statusskip) last = line;
+        }
+        if (last) { snprintf(status, sizeof(status), "%.*s", (int)sizeof(status) - 1, last); dirtyinfo = True; last = NULL; }
+        memmove(statusbuf, line, (statuslen -= line - statusbuf) + 1);
+        /* a line filling the buffer is longer than the status holds,
+         * it is dropped up to its newline instead of showing its tail */
+        if (statuslen == sizeof(statusbuf) - 1) statuslen = 0, statusskip = True;
+        line = statusbuf;
+    }
+}
+
 /**
  * remove the specified client from the given desktop
  *
@@ -1027,14 +2168,30 @@ void quit(const Arg *arg) {
  * if c was the current client, current must be updated.
  */
 void removeclient(Client *c, Desktop *d, Monitor *m) {
-    Client **p = NULL;
-    for (p = &d->head; *p && (*p != c); p = &(*p)->next);
-    if (!*p) return; else *p = c->next;
+    detach(c, d);
     if (c == d->prev && !(d->prev = prevclient(d->curr, d))) d->prev = d->head;
     if (c == d->curr || (d->head && !d->head->next)) focus(d->prev, d, m);
     if (!(c->isfloat || c->istrans) || (d->head && !d->head->next)) tile(d, m);
-    free(c);
-    desktopinfo();
+    XDeleteContext(dis, c->win, clientctx);
+    freeclient(c);
+    dirtyinfo = True;
+}
+
+/**
+ * move and resize the client's window to the given geometry,
+ * unless that is the geometry the window already has
+ */
+void resize(Client *c, int x, int y, int w, int h) {
+    if (c->x == x && c->y == y && c->w == w && c->h == h) {
+#ifdef DEBUG
+        stats.suppressed++;
+#endif
+        return;
+    }
+#ifdef DEBUG
+    stats.issued++;
+#endif
+    XMoveResizeWindow(dis, c->win, c->x = x, c->y = y, c->w = w, c->h = h);
 }
 
 /**
@@ -1066,22 +2223,277 @@ void rotate(const Arg *arg) {
 }
 
 /**
- * jump and focus the next non-empty desktop
+ * jump and focus the next non-empty desktop, stepping arg->i desktops
+ * at a time, and stay if every desktop on the way is empty
  */
 void rotate_filled(const Arg *arg) {
     Monitor *m = &monitors[currmonidx];
+    if (!arg->i || abs(arg->i) >= DESKTOPS) return;
     int n = arg->i;
-    while (n < DESKTOPS && !m->desktops[(DESKTOPS + m->currdeskidx + n) % DESKTOPS].head) (n += arg->i);
-    change_desktop(&(Arg){.i = (DESKTOPS + m->currdeskidx + n) % DESKTOPS});
+    while (abs(n) < DESKTOPS && !m->desktops[(DESKTOPS + m->currdeskidx + n) % DESKTOPS].head) (n += arg->i);
+    if (abs(n) < DESKTOPS) change_desktop(&(Arg){.i = (DESKTOPS + m->currdeskidx + n) % DESKTOPS});
+}
+
+/**
+ * to restart stop receiving events, save the state
+ * and execute the wm again, keeping all windows
+ */
+void restart(void) {
+    restarting = True;
+    running = False;
+}
+
+/**
+ * tile the current desktop of each monitor if it was marked dirty (see tile)
+ * call the tiling handler fucntion taking account the panel height
+ * and move and resize the tiled clients to the geometry it computed
+ */
+void retile(void) {
+    for (int cm = 0; cm < nmonitors; cm++) {
+        Monitor *m = &monitors[cm]; Desktop *d = &m->desktops[m->currdeskidx];
+        if (!d->dirty) continue; else d->dirty = False;
+        if (!d->head || d->mode == FLOAT) continue;
+
+        int n = 0, i = 0;
+        for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) n++;
+        if (!n) continue; else if (n > nrects) {
+            Rect *r = realloc(rects, n * sizeof(Rect));
+            if (!r) err(EXIT_FAILURE, "cannot allocate layout");
+            rects = r; nrects = n;
+        }
+        layout[d->head->next ? d->mode:MONOCLE](m->x, m->y + (TOP_PANEL && d->sbar ? PANEL_HEIGHT:0),
+                                                m->w, m->h - (d->sbar ? PANEL_HEIGHT:0), d, n, rects);
+        for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) {
+            resize(c, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+            i++;
+        }
+    }
 }
 
 /**
  * main event loop
  * on receival of an event call the appropriate handler
+ *
+ * events are handled in batches of what is queued, redundant
+ * events are dropped (see coalesce) and work that only needs
+ * to be done once per batch is done when the queue is drained
+ *
+ * once drained, wait for either the display connection
+ * or the command socket and its connections to be readable
  */
 void run(void) {
+    int xfd = ConnectionNumber(dis), nfds = 0;
+    fd_set fds;
     XEvent ev;
-    while(running && !XNextEvent(dis, &ev)) if (events[ev.type]) events[ev.type](&ev);
+
+    while (running) {
+        if (XPending(dis)) {
+            XNextEvent(dis, &ev);
+            coalesce(&ev);
+            if (ev.type < LASTEvent && events[ev.type]) PROF(ev.type, events[ev.type](&ev));
+            else if (randrbase >= 0 && (ev.type == randrbase + RRScreenChangeNotify || ev.type == randrbase + RRNotify))
+                randrnotify(&ev);
+#ifdef PROFILE
+            if (evlog && ev.type < LASTEvent && events[ev.type]) proflog(&ev);
+#endif
+            continue;
+        }
+        if (dirtygeom) { dirtygeom = False; PROF(PROF_GEOM, updategeom()); }
+        PROF(PROF_RETILE, retile());
+        if (dirtyinfo) PROF(PROF_INFO, desktopinfo());
+        if (XPending(dis)) continue; /* also flushes the requests */
+#ifdef PROFILE
+        if (dumpprof) { dumpprof = 0; profreport(); }
+#endif
+
+        FD_ZERO(&fds);
+        FD_SET(xfd, &fds);
+        if (ipcfd >= 0) FD_SET(ipcfd, &fds);
+        if (statusfd >= 0) FD_SET(statusfd, &fds);
+        nfds = xfd > ipcfd ? xfd:ipcfd;
+        if (statusfd > nfds) nfds = statusfd;
+        for (unsigned int i = 0; i < LENGTH(conns); i++) if (conns[i].fd >= 0) {
+            FD_SET(conns[i].fd, &fds);
+            if (conns[i].fd > nfds) nfds = conns[i].fd;
+        }
+        if (select(nfds + 1, &fds, NULL, NULL, NULL) < 0) {
+            if (errno == EINTR) continue; else err(EXIT_FAILURE, "select");
+        }
+        for (unsigned int i = 0; i < LENGTH(conns); i++)
+            if (conns[i].fd >= 0 && FD_ISSET(conns[i].fd, &fds)) PROF(PROF_IPC, ipcread(i));
+        if (ipcfd >= 0 && FD_ISSET(ipcfd, &fds)) ipcaccept();
+        if (statusfd >= 0 && FD_ISSET(statusfd, &fds)) readstatus();
+    }
+}
+
+/**
+ * place a runtime file of the config in $XDG_RUNTIME_DIR, or in /tmp if
+ * it is not set, with the display appended to the name so that several
+ * displays do not share it
+ */
+Bool runtimepath(char *path, size_t size, const char *name) {
+    const char *dir = getenv("XDG_RUNTIME_DIR"), *dpy = DisplayString(dis);
+    int n = snprintf(path, size, "%s/%s%s", dir && *dir ? dir:"/tmp", name, dpy);
+    if (n < 0 || (size_t)n >= size) return False;
+    for (char *s = path + n - strlen(dpy); *s; s++) if (*s == '/') *s = '_';
+    return True;
+}
+
+/**
+ * save the state of the monitors, desktops and clients on the root
+ * window, for the restarted wm to restore it (see scan)
+ *
+ * the state is an array of cardinals, holding
+ *   - the number of monitors, the number of desktops and the current monitor
+ *   - for each monitor, the current and previous desktop
+ *   - for each desktop, the mode, master and stack size and panel visibility
+ *   - for each client, in the order of the client list of each desktop,
+ *     the window, monitor, desktop, state flags and position
+ */
+void savestate(void) {
+    int n = 3 + 2 * nmonitors + 4 * nmonitors * DESKTOPS, i = 0;
+    for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) n += 6 * monitors[cm].desktops[cd].count;
+    long *state = calloc(n, sizeof(long));
+    if (!state) return;
+
+    state[i++] = nmonitors; state[i++] = DESKTOPS; state[i++] = currmonidx;
+    for (int cm = 0; cm < nmonitors; cm++) {
+        state[i++] = monitors[cm].currdeskidx;
+        state[i++] = monitors[cm].prevdeskidx;
+    }
+    for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+        Desktop *d = &monitors[cm].desktops[cd];
+        state[i++] = d->mode; state[i++] = d->masz; state[i++] = d->sasz; state[i++] = d->sbar;
+    }
+    for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+        Desktop *d = &monitors[cm].desktops[cd];
+        Bool hidden = !UNMAP_HIDDEN && cd != monitors[cm].currdeskidx;
+        for (Client *c = d->head; c; c = c->next) {
+            state[i++] = c->win; state[i++] = cm; state[i++] = cd;
+            state[i++] = (c->isfloat ? STATE_FLOAT:0) | (c->isfull ? STATE_FULL:0)
+                       | (c == d->curr ? STATE_CURR:0) | (c == d->prev ? STATE_PREV:0);
+            state[i++] = c->x - (hidden ? off_x:0); state[i++] = c->y - (hidden ? off_y:0);
+        }
+    }
+    XChangeProperty(dis, root, XInternAtom(dis, "_MONSTERWM_STATE", False), XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)state, n);
+    free(state);
+}
+
+/**
+ * manage the windows that already exist, as when the wm is restarted
+ *
+ * mapped windows and iconic windows, which were hidden by the
+ * previous wm (see hide), are managed. the requests about all
+ * windows are sent before waiting on any reply, so that the
+ * windows are managed in one round trip.
+ *
+ * if the previous wm saved its state (see savestate) the
+ * windows, desktops and monitors are restored to that state.
+ */
+void scan(void) {
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    Atom prop = XInternAtom(dis, "_MONSTERWM_STATE", False), type;
+    unsigned long n = 0, after = 0;
+    unsigned int nwins = 0;
+    int format = 0;
+    long *state = NULL;
+    Window root_return, parent_return, *wins = NULL;
+
+    if (XGetWindowProperty(dis, root, prop, 0, 1L << 20, True, XA_CARDINAL, &type, &format, &n, &after,
+                           (unsigned char **)&state) != Success || format != 32 || n < 3
+                           || state[0] < 1 || state[1] != DESKTOPS
+                           || n < 3 + (2 + 4 * DESKTOPS) * (unsigned long)state[0]) n = 0;
+    long sm = n ? state[0]:0, *ds = n ? state + 3 + 2 * sm:NULL, *cs = n ? ds + 4 * sm * DESKTOPS:NULL;
+    unsigned long ncs = n ? (n - (cs - state)) / 6:0;
+
+    /* sizes resize_master and resize_stack would not reach on the monitor,
+     * which may have changed since, are reset */
+    for (int cm = 0; cm < sm && cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+        Monitor *m = &monitors[cm]; Desktop *d = &m->desktops[cd]; const long *v = ds + 4 * (cm * DESKTOPS + cd);
+        if (v[0] >= 0 && v[0] < MODES) d->mode = v[0];
+        const int size = d->mode == BSTACK ? m->h:m->w, msz = v[1] > -size && v[1] < size ? size * MASTER_SIZE + v[1]:0;
+        d->masz = msz >= MINWSZ && size - msz >= MINWSZ ? v[1]:0;
+        const int ssz = d->mode == BSTACK ? m->w:m->h;
+        d->sasz = v[2] > -ssz && v[2] < ssz ? v[2]:0;
+        d->sbar = v[3] != 0;
+    }
+
+    XQueryTree(dis, root, &root_return, &parent_return, &wins, &nwins);
+    Query *qs = calloc(nwins, sizeof(Query));
+    xcb_get_window_attributes_cookie_t *ac = calloc(nwins, sizeof(*ac));
+    xcb_get_property_cookie_t *sc = calloc(nwins, sizeof(*sc));
+    const long **saved = calloc(ncs + 1, sizeof(*saved));
+    if ((nwins && (!qs || !ac || !sc)) || !saved) err(EXIT_FAILURE, "cannot allocate windows");
+
+    for (unsigned int i = 0; i < nwins; i++) {
+        ac[i] = xcb_get_window_attributes(xc, wins[i]);
+        sc[i] = xcb_get_property(xc, False, wins[i], wmatoms[WM_STATE], wmatoms[WM_STATE], 0, 1);
+    }
+    for (unsigned int i = 0; i < nwins; i++) {
+        xcb_get_window_attributes_reply_t *wa = xcb_get_window_attributes_reply(xc, ac[i], NULL);
+        xcb_get_property_reply_t *sr = xcb_get_property_reply(xc, sc[i], NULL);
+        Bool iconic = sr && xcb_get_property_value_length(sr) >= 4 && *(uint32_t *)xcb_get_property_value(sr) == IconicState;
+        if (!wa || wa->override_redirect || (wa->map_state != XCB_MAP_STATE_VIEWABLE && !iconic)) wins[i] = None;
+        else query(wins[i], &qs[i]);
+        free(wa); free(sr);
+    }
+
+    /* adopt the saved windows first, each with its state looked up by
+     * window, then put them in the order of their client lists, and place
+     * and focus the current client of each desktop once for all windows */
+    for (unsigned long k = 0; k < ncs; k++) saved[k] = cs + 6 * k;
+    qsort(saved, ncs, sizeof(*saved), statecmp);
+    adopting = True;
+    for (int pass = 0; pass < 2; pass++) for (unsigned int i = 0; i < nwins; i++) if (wins[i]) {
+        const long w = wins[i], *key = &w, **s = bsearch(&key, saved, ncs, sizeof(*saved), statecmp);
+        if (!s == !pass) continue;
+        manage(wins[i], &qs[i], s ? *s:NULL);
+        wins[i] = None;
+    }
+    adopting = False;
+    free(qs); free(ac); free(sc); free(saved);
+    if (wins) XFree(wins);
+
+    for (unsigned long k = 0; k < ncs; k++) {
+        Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
+        if (!wintoclient(cs[6 * k], &c, &d, &m)) continue;
+        detach(c, d); attach(c, NULL, d); /* keep the saved order whatever ATTACH_ASIDE is */
+        if (cs[6 * k + 3] & STATE_PREV) d->prev = c;
+        if (cs[6 * k + 3] & STATE_CURR) d->curr = c;
+    }
+    for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+        Desktop *d = &monitors[cm].desktops[cd];
+        if (!d->curr) continue;
+        if (d->prev == d->curr) d->prev = prevclient(d->curr, d);
+        focus(d->curr, d, &monitors[cm]);
+    }
+
+    for (int cm = 0; cm < sm && cm < nmonitors; cm++) {
+        const long *v = state + 3 + 2 * cm;
+        change_monitor(&(Arg){.i = cm});
+        if (v[0] >= 0 && v[0] < DESKTOPS) change_desktop(&(Arg){.i = v[0]});
+        if (v[1] >= 0 && v[1] < DESKTOPS) monitors[cm].prevdeskidx = v[1];
+        tile(&monitors[cm].desktops[monitors[cm].currdeskidx], &monitors[cm]);
+    }
+    if (n) change_monitor(&(Arg){.i = state[2] < nmonitors ? state[2]:nmonitors - 1});
+    if (state) XFree(state);
+    retile();
+}
+
+/**
+ * order saved client states by their window, for scan to look them up
+ */
+int statecmp(const void *a, const void *b) {
+    const Window x = (*(const long *const *)a)[0], y = (*(const long *const *)b)[0];
+    return (x > y) - (x < y);
+}
+
+/**
+ * set the border width of the client's window, if it changed
+ */
+void setborder(Client *c, int bw) {
+    if (c->bw != bw) XSetWindowBorderWidth(dis, c->win, c->bw = bw);
 }
 
 /**
@@ -1099,9 +2511,9 @@ void setfullscreen(Client *c, Desktop *d, Monitor *m, Bool fullscrn) {
     if (fullscrn != c->isfull) XChangeProperty(dis, c->win,
             netatoms[NET_WM_STATE], XA_ATOM, 32, PropModeReplace, (unsigned char*)
             ((c->isfull = fullscrn) ? &netatoms[NET_FULLSCREEN]:0), fullscrn);
-    Bool b = (&m->desktops[m->currdeskidx] == d);
-    if (fullscrn) MVRSZ(c, m->x + (b ? 0:off_x), m->y + (b ? 0:off_y), m->w, m->h);
-    XSetWindowBorderWidth(dis, c->win, (c->isfull || !d->head->next ? 0:BORDER_WIDTH));
+    Bool b = (UNMAP_HIDDEN || &m->desktops[m->currdeskidx] == d);
+    if (fullscrn) resize(c, m->x + (b ? 0:off_x), m->y + (b ? 0:off_y), m->w, m->h);
+    setborder(c, (c->isfull || !d->head->next ? 0:BORDER_WIDTH));
 }
 
 /**
@@ -1114,59 +2526,60 @@ void setup(void) {
     const int screen = DefaultScreen(dis);
     root = RootWindow(dis, screen);
 
-    /* initialize monitors and desktops */
-    XineramaScreenInfo *info = XineramaQueryScreens(dis, &nmonitors);
-
-    if (!nmonitors || !info)
-        errx(EXIT_FAILURE, "Xinerama is not active");
-    if (!(monitors = calloc(nmonitors, sizeof(Monitor))))
-        err(EXIT_FAILURE, "cannot allocate monitors");
-
-    for (int m = 0; m < nmonitors; m++) {
-        const int *layout = NULL;
-        Bool sbar         = SHOW_PANEL;
-
-        if ((int)LENGTH(monitorcfg) > m) {
-            layout = monitorcfg[m].layout;
-            sbar   = monitorcfg[m].sbar;
-        }
-        monitors[m] = (Monitor){ .x = info[m].x_org, .y = info[m].y_org,
-                                 .w = info[m].width, .h = info[m].height };
-        for (unsigned int d = 0; d < DESKTOPS; d++) {
-            monitors[m].desktops[d] = (Desktop){ .mode = DEFAULT_MODE, .sbar = sbar };
-            if (layout && layout[d] != -1) monitors[m].desktops[d].mode = layout[d];
-            else layout = NULL;
-
-        }
-    }
-    XFree(info);
+    /* initialize monitors and desktops, and the offsets to move windows out of view */
+    updategeom();
 
-    /* set offset values used to move windows out of view */
-    off_x = 2 * (monitors[nmonitors - 1].x + monitors[nmonitors - 1].w);
-    off_y = 2 * (monitors[nmonitors - 1].y + monitors[nmonitors - 1].h);
+    /* index of managed windows to their clients */
+    clientctx = XUniqueContext();
 
     /* get color for focused and unfocused client borders */
     win_focus = getcolor(FOCUS, screen);
     win_unfocus = getcolor(UNFOCUS, screen);
     win_infocus = getcolor(INFOCUS, screen);
 
-    /* set numlockmask */
-    XModifierKeymap *modmap = XGetModifierMapping(dis);
-    for (int k = 0; k < 8; k++) for (int j = 0; j < modmap->max_keypermod; j++)
-        if (modmap->modifiermap[modmap->max_keypermod*k + j] == XKeysymToKeycode(dis, XK_Num_Lock))
-            numlockmask = (1 << k);
-    XFreeModifiermap(modmap);
+    /* the font and colors of the built-in bar, and the fifo of its status text */
+    if (BUILTIN_BAR) {
+        if (!(barfont = XLoadQueryFont(dis, BAR_FONT)) && !(barfont = XLoadQueryFont(dis, "fixed")))
+            errx(EXIT_FAILURE, "cannot load font %s", BAR_FONT);
+        bargc = XCreateGC(dis, root, 0, NULL);
+        XSetFont(dis, bargc, barfont->fid);
+        bar_fg = getcolor(BAR_FG, screen);
+        bar_bg = getcolor(BAR_BG, screen);
+        bar_urgent = getcolor(BAR_URGENT, screen);
+        /* the fifo is placed as the command socket below, and an existing
+         * file is only read if it is a fifo of this user, checked again on
+         * the opened file as the path may be replaced in between */
+        const char *name = STATUS_FIFO;
+        char fifo[sizeof(ipcaddr.sun_path)];
+        struct stat fs;
+        if (name && !runtimepath(fifo, sizeof(fifo), name))
+            warnx("fifo path too long: %s", name);
+        else if (name && !lstat(fifo, &fs) && (!S_ISFIFO(fs.st_mode) || fs.st_uid != getuid()))
+            warnx("not using %s: not a fifo of this user", fifo);
+        else if (name && ((mkfifo(fifo, 0600) && errno != EEXIST)
+                      || (statusfd = open(fifo, O_RDWR|O_NONBLOCK|O_CLOEXEC|O_NOFOLLOW)) < 0))
+            warn("cannot open %s", fifo);
+        else if (name && (fstat(statusfd, &fs) || !S_ISFIFO(fs.st_mode) || fs.st_uid != getuid())) {
+            warnx("not using %s: not a fifo of this user", fifo);
+            close(statusfd);
+            statusfd = -1;
+        } else if (name) setenv("MONSTERWM_STATUS", fifo, 1);
+    }
 
     /* set up atoms for dialog/notification windows */
     wmatoms[WM_PROTOCOLS]     = XInternAtom(dis, "WM_PROTOCOLS",     False);
     wmatoms[WM_DELETE_WINDOW] = XInternAtom(dis, "WM_DELETE_WINDOW", False);
     wmatoms[UTF8_STRING]      = XInternAtom(dis, "UTF8_STRING", False);
+    wmatoms[WM_ROLE]          = XInternAtom(dis, "WM_WINDOW_ROLE", False);
+    wmatoms[WM_STATE]         = XInternAtom(dis, "WM_STATE", False);
     netatoms[NET_SUPPORTED]   = XInternAtom(dis, "_NET_SUPPORTED",   False);
     netatoms[NET_WM_STATE]    = XInternAtom(dis, "_NET_WM_STATE",    False);
     netatoms[NET_ACTIVE]      = XInternAtom(dis, "_NET_ACTIVE_WINDOW",       False);
     netatoms[NET_FULLSCREEN]  = XInternAtom(dis, "_NET_WM_STATE_FULLSCREEN", False);
     netatoms[NET_WM_NAME]     = XInternAtom(dis, "_NET_WM_NAME", False);
 
+    compilerules(rules, LENGTH(rules));
+
     /* propagate EWMH support */
     XChangeProperty(dis, root, netatoms[NET_SUPPORTED], XA_ATOM, 32,
               PropModeReplace, (unsigned char *)netatoms, NET_COUNT);
@@ -1178,14 +2591,71 @@ void setup(void) {
     XSetErrorHandler(xerrorstart);
     /* set masks for reporting events handled by the wm */
     XSelectInput(dis, DefaultRootWindow(dis), SubstructureRedirectMask|ButtonPressMask|
-                                              SubstructureNotifyMask|PropertyChangeMask);
+                                              SubstructureNotifyMask|PropertyChangeMask|StructureNotifyMask);
+    /* and for changes of the outputs, which the root window may not see */
+    if (XRRQueryExtension(dis, &randrbase, &(int){0}))
+        XRRSelectInput(dis, root, RRScreenChangeNotifyMask|RRCrtcChangeNotifyMask|RROutputChangeNotifyMask);
+    else randrbase = -1;
     XSync(dis, False);
     XSetErrorHandler(xerror);
     XSync(dis, False);
+#ifdef PROFILE
+    XSetAfterFunction(dis, profafter);
+    clock_gettime(CLOCK_MONOTONIC, &evstart);
+    if (getenv("MONSTERWM_EVENTLOG") && !(evlog = fopen(getenv("MONSTERWM_EVENTLOG"), "a")))
+        warn("cannot open event log %s", getenv("MONSTERWM_EVENTLOG"));
+    if (signal(SIGUSR1, sigusr1) == SIG_ERR) err(EXIT_FAILURE, "cannot install SIGUSR1 handler");
+#endif
+
+    /* listen for commands on the command socket (see run),
+     * replacing only a stale socket of this user */
+    const char *path = IPC_SOCKET;
+    struct stat st;
+    for (unsigned int i = 0; i < LENGTH(conns); i++) conns[i].fd = -1;
+    if (path && !runtimepath(ipcaddr.sun_path, sizeof(ipcaddr.sun_path), path))
+        warnx("socket path too long: %s", path);
+    else if (path && !lstat(ipcaddr.sun_path, &st) && (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()))
+        warnx("not using %s: not a socket of this user", ipcaddr.sun_path);
+    else if (path) {
+        unlink(ipcaddr.sun_path);
+        mode_t mask = umask(0077);
+        if ((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(ipcfd, (struct sockaddr *)&ipcaddr, sizeof(ipcaddr))
+                                                        || listen(ipcfd, SOMAXCONN)) {
+            warn("cannot listen on %s", ipcaddr.sun_path);
+            if (ipcfd >= 0) close(ipcfd);
+            ipcfd = -1;
+        } else {
+            setenv("MONSTERWM_SOCKET", ipcaddr.sun_path, 1);
+            fcntl(ipcfd, F_SETFL, fcntl(ipcfd, F_GETFL) | O_NONBLOCK);
+            fcntl(ipcfd, F_SETFD, FD_CLOEXEC);
+        }
+        umask(mask);
+    }
 
     grabkeys();
     if (DEFAULT_DESKTOP >= 0 && DEFAULT_DESKTOP < DESKTOPS) change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
     if (DEFAULT_MONITOR >= 0 && DEFAULT_MONITOR < nmonitors) change_monitor(&(Arg){.i = DEFAULT_MONITOR});
+    scan();
+}
+
+/**
+ * set the ICCCM WM_STATE of a window, normal or iconic
+ */
+void setwmstate(Window w, long state) {
+    long data[] = { state, None };
+    XChangeProperty(dis, w, wmatoms[WM_STATE], wmatoms[WM_STATE], 32, PropModeReplace, (unsigned char *)data, 2);
+}
+
+/**
+ * show a client of a desktop that became visible
+ * undo what hide() did
+ */
+void show(Client *c) {
+    if (!UNMAP_HIDDEN) { MV(c, c->x - off_x, c->y - off_y); return; }
+    if (!c->ishide) return;
+    c->ishide = False;
+    XMapWindow(dis, c->win);
+    setwmstate(c->win, NormalState);
 }
 
 void sigchld(__attribute__((unused)) int sig) {
@@ -1193,6 +2663,15 @@ void sigchld(__attribute__((unused)) int sig) {
     else err(EXIT_FAILURE, "cannot install SIGCHLD handler");
 }
 
+#ifdef PROFILE
+/**
+ * request the profile to be printed, when the event loop is idle
+ */
+void sigusr1(__attribute__((unused)) int sig) {
+    dumpprof = 1;
+}
+#endif
+
 #define SPAWN_CWD_DELIM "()[]{}[]<>\"':"
 #include <libgen.h>
 #include <sys/stat.h>
@@ -1303,18 +2782,60 @@ void spawn(const Arg *arg) {
     err(EXIT_SUCCESS, "execvp %s", (char *)arg->com[0]);
 }
 
+/**
+ * predicate for coalesce, whether the queued event e supersedes arg
+ */
+Bool supersedes(__attribute__((unused)) Display *dis, XEvent *e, XPointer arg) {
+    XEvent *ev = (XEvent *)arg;
+    if (e->type != ev->type) return False;
+    switch (e->type) {
+        case ConfigureRequest: return e->xconfigurerequest.window == ev->xconfigurerequest.window
+                                   && e->xconfigurerequest.value_mask == ev->xconfigurerequest.value_mask;
+        case PropertyNotify:   return e->xproperty.window == ev->xproperty.window
+                                   && e->xproperty.atom == ev->xproperty.atom;
+        case EnterNotify:      return e->xcrossing.mode == ev->xcrossing.mode
+                                   && e->xcrossing.detail == ev->xcrossing.detail;
+        case MotionNotify:     return e->xmotion.window == ev->xmotion.window;
+    }
+    return False;
+}
+
+/**
+ * spiral aka fibonacci layout
+ * the first window covers the master area and each next window half
+ * of the space that is left, going clockwise: left, top, right, bottom
+ */
+void spiral(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) {
+    w -= BORDER_WIDTH; h -= BORDER_WIDTH;
+
+    for (int i = 0, cw = 0, ch = 0; i < n; i++) {
+        if (i == n - 1) r[i] = CELL(x, y, w, h);
+        else if (i % 2 == 0) {
+            cw = i ? w/2:w * MASTER_SIZE + d->masz;
+            r[i] = CELL(i % 4 ? x + w - cw:x, y, cw, h);
+            if (i % 4 == 0) x += cw;
+            w -= cw;
+        } else {
+            ch = h/2;
+            r[i] = CELL(x, i % 4 == 3 ? y + h - ch:y, w, ch);
+            if (i % 4 == 1) y += ch;
+            h -= ch;
+        }
+    }
+}
+
 /**
  * tile or common tiling aka v-stack mode/layout
  * bstack or bottom stack aka h-stack mode/layout
  */
-void stack(int x, int y, int w, int h, const Desktop *d) {
-    Client *c = NULL, *t = NULL; Bool b = (d->mode == BSTACK);
-    int n = 0, p = 0, z = (b ? w:h), ma = (b ? h:w) * MASTER_SIZE + d->masz;
+void stack(int x, int y, int w, int h, const Desktop *d, int n, Rect *r) {
+    Bool b = (d->mode == BSTACK);
+    int p = 0, z = (b ? w:h), ma = (b ? h:w) * MASTER_SIZE + d->masz;
 
-    /* count stack windows and grab first non-floating, non-fullscreen window */
-    for (t = d->head; t; t = t->next) if (!ISFFT(t)) { if (c) ++n; else c = t; }
+    /* the first tiled window is the master, the rest are stack windows */
+    if (n-- == 0) return;
 
-    /* if there is only one window (c && !n), it should cover the available screen space
+    /* if there is only one window (!n), it should cover the available screen space
      * if there is only one stack window, then we don't care about growth
      * if more than one stack windows (n > 1) adjustments may be needed.
      *
@@ -1342,40 +2863,52 @@ void stack(int x, int y, int w, int h, const Desktop *d) {
      * in the end, we know each client's height/width (z), and how many pixels
      * should be added to the first stack client (p) so that it satisfies sasz,
      * and also, does not result in gaps created on the bottom of the screen.
+     *
+     * a sasz larger than the stack would leave the first or the other stack
+     * windows no room, and push the rest out of the screen, so z is kept
+     * between the room of a window's borders (q) and what the others leave.
+     * the first stack window is then what the others leave: p = z - n*s
      */
-    if (c && !n) MVRSZ(c, x, y, w - 2*BORDER_WIDTH, h - 2*BORDER_WIDTH);
-    if (!c || !n) return; else if (n > 1) { p = (z - d->sasz)%n + d->sasz; z = (z - d->sasz)/n; }
+    if (!n) r[0] = (Rect){ x, y, w - 2*BORDER_WIDTH, h - 2*BORDER_WIDTH };
+    if (!n) return; else if (n > 1) {
+        int s = (z - d->sasz)/n, q = 2*BORDER_WIDTH + 1;
+        if (z >= n*q) s = s < q ? q:s > (z - q)/(n - 1) ? (z - q)/(n - 1):s;
+        p = z - n*s; z = s;
+    }
 
-    /* tile the first non-floating, non-fullscreen window to cover the master area */
-    if (b) MVRSZ(c, x, y, w - 2*BORDER_WIDTH, ma - BORDER_WIDTH);
-    else   MVRSZ(c, x, y, ma - BORDER_WIDTH, h - 2*BORDER_WIDTH);
+    /* tile the first window to cover the master area */
+    if (b) r[0] = (Rect){ x, y, w - 2*BORDER_WIDTH, ma - BORDER_WIDTH };
+    else   r[0] = (Rect){ x, y, ma - BORDER_WIDTH, h - 2*BORDER_WIDTH };
 
-    /* tile the next non-floating, non-fullscreen (and first) stack window adding p */
-    for (c = c->next; c && ISFFT(c); c = c->next);
+    /* tile the first stack window adding p */
     int cw = (b ? h:w) - 2*BORDER_WIDTH - ma, ch = z - BORDER_WIDTH;
-    if (b) MVRSZ(c, x, y += ma, ch - BORDER_WIDTH + p, cw);
-    else   MVRSZ(c, x += ma, y, cw, ch - BORDER_WIDTH + p);
-
-    /* tile the rest of the non-floating, non-fullscreen stack windows */
-    for (b ? (x += ch+p):(y += ch+p), c = c->next; c; c = c->next) {
-        if (ISFFT(c)) continue;
-        if (b) { MVRSZ(c, x, y, ch, cw); x += z; }
-        else   { MVRSZ(c, x, y, cw, ch); y += z; }
+    if (b) r[1] = (Rect){ x, y += ma, ch - BORDER_WIDTH + p, cw };
+    else   r[1] = (Rect){ x += ma, y, cw, ch - BORDER_WIDTH + p };
+
+    /* tile the rest of the stack windows */
+    b ? (x += ch+p):(y += ch+p);
+    for (int i = 2; i <= n; i++) {
+        if (b) { r[i] = (Rect){ x, y, ch, cw }; x += z; }
+        else   { r[i] = (Rect){ x, y, cw, ch }; y += z; }
     }
 }
 
 /**
  * swap master window with current.
  * if current is head swap with next
- * if current is not head, then head
- * is behind us, so move_up until we
- * are the head
+ * if current is not head, then move
+ * current to be the head, keeping the
+ * order of the rest of the clients
  */
 void swap_master(void) {
     Desktop *d = &monitors[currmonidx].desktops[monitors[currmonidx].currdeskidx];
     if (!d->curr || !d->head->next) return;
     if (d->curr == d->head) move_down();
-    else while (d->curr != d->head) move_up();
+    else {
+        detach(d->curr, d);
+        attach(d->curr, d->head, d);
+        if (!d->curr->isfloat && !d->curr->istrans) tile(d, &monitors[currmonidx]);
+    }
     focus(d->head, d, &monitors[currmonidx]);
 }
 
@@ -1387,20 +2920,22 @@ void swap_master(void) {
  */
 void switch_mode(const Arg *arg) {
     Desktop *d = &monitors[currmonidx].desktops[monitors[currmonidx].currdeskidx];
+    if (arg->i < 0 || arg->i >= MODES) return;
     if (d->mode != arg->i) d->mode = arg->i;
     else if (d->mode != FLOAT) for (Client *c = d->head; c; c = c->next) c->isfloat = False;
     if (d->head) { tile(d, &monitors[currmonidx]); focus(d->curr, d, &monitors[currmonidx]); }
-    desktopinfo();
+    dirtyinfo = True;
 }
 
 /**
  * tile clients of the given desktop with the desktop's mode/layout
- * call the tiling handler fucntion taking account the panel height
+ *
+ * only the monitor's current desktop is visible and needs tiling.
+ * it is marked dirty and tiled once at the end of the event batch,
+ * however many times its state changed during the batch (see retile)
  */
 void tile(Desktop *d, Monitor *m) {
-    if (&m->desktops[m->currdeskidx] != d || !d->head || d->mode == FLOAT) return;
-    layout[d->head->next ? d->mode:MONOCLE](m->x, m->y + (TOP_PANEL && d->sbar ? PANEL_HEIGHT:0),
-                                            m->w, m->h - (d->sbar ? PANEL_HEIGHT:0), d);
+    if (&m->desktops[m->currdeskidx] == d) d->dirty = True;
 }
 
 /**
@@ -1410,24 +2945,213 @@ void togglepanel(void) {
     Monitor *m = &monitors[currmonidx];
     m->desktops[m->currdeskidx].sbar = !m->desktops[m->currdeskidx].sbar;
     tile(&m->desktops[m->currdeskidx], m);
+    dirtyinfo = True;
 }
 
 /**
  * windows that request to unmap should lose their client
  * so invisible windows do not exist on screen
+ *
+ * windows unmapped by hide() keep their client
  */
 void unmapnotify(XEvent *e) {
     Monitor *m = NULL; Desktop *d = NULL; Client *c = NULL;
-    if (wintoclient(e->xunmap.window, &c, &d, &m)) removeclient(c, d, m);
+    if (!wintoclient(e->xunmap.window, &c, &d, &m)) return;
+    if (c->unmaps && !e->xunmap.send_event) c->unmaps--; else removeclient(c, d, m);
+}
+
+/**
+ * draw the built-in bar of the monitor, if its current desktop shows the panel
+ *
+ * the bar holds a segment for each desktop, with the number of the
+ * desktop and its windows, the name of the mode and the status text.
+ * the segments are drawn on a pixmap, and only segments that changed
+ * are drawn again. only the changed part of the pixmap is copied to
+ * the window, and exposures are copied from the pixmap as they are.
+ *
+ * when the panel is hidden the bar is unmapped, and keeps its window
+ * and pixmap, and when shown again is mapped and exposed as it was,
+ * with the segments that changed meanwhile drawn again.
+ */
+void updatebar(Monitor *m) {
+    Desktop *d = &m->desktops[m->currdeskidx];
+    if (!d->sbar || PANEL_HEIGHT <= 0) {
+        if (m->barmapped) XUnmapWindow(dis, m->bar);
+        m->barmapped = False;
+        return;
+    }
+
+    const int fh = barfont->ascent + barfont->descent, pad = fh/2;
+    if (!m->bar) {
+        XSetWindowAttributes wa = { .override_redirect = True, .background_pixmap = None, .event_mask = ExposureMask };
+        m->bar = XCreateWindow(dis, root, m->x, TOP_PANEL ? m->y:m->y + m->h - PANEL_HEIGHT, m->w, PANEL_HEIGHT, 0,
+                               CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect|CWBackPixmap|CWEventMask, &wa);
+        m->buf = XCreatePixmap(dis, m->bar, m->w, PANEL_HEIGHT, DefaultDepth(dis, DefaultScreen(dis)));
+        XSetForeground(dis, bargc, bar_bg);
+        XFillRectangle(dis, m->buf, bargc, 0, 0, m->w, PANEL_HEIGHT);
+        for (unsigned int i = 0; i < LENGTH(m->segs); i++) m->segs[i].x = -1; /* draw every segment */
+    }
+    if (!m->barmapped) { XMapRaised(dis, m->bar); m->barmapped = True; }
+
+    Segment segs[LENGTH(m->segs)];
+    for (int cd = 0; cd < DESKTOPS; cd++) {
+        const Desktop *n = &m->desktops[cd];
+        snprintf(segs[cd].text, sizeof(segs[cd].text), n->count ? "%d:%d":"%d", cd + 1, n->count);
+        segs[cd].fg = bar_fg;
+        segs[cd].bg = cd == m->currdeskidx ? (m == &monitors[currmonidx] ? win_focus:win_infocus):n->urgn ? bar_urgent:bar_bg;
+    }
+    if (d->mode >= 0 && d->mode < (int)LENGTH(modenames) && modenames[d->mode])
+        snprintf(segs[DESKTOPS].text, sizeof(segs[DESKTOPS].text), "%s", modenames[d->mode]);
+    else snprintf(segs[DESKTOPS].text, sizeof(segs[DESKTOPS].text), "%d", d->mode);
+    snprintf(segs[DESKTOPS + 1].text, sizeof(segs[DESKTOPS + 1].text), "%s", status);
+    segs[DESKTOPS].fg = segs[DESKTOPS + 1].fg = bar_fg;
+    segs[DESKTOPS].bg = segs[DESKTOPS + 1].bg = bar_bg;
+
+    /* the text is only measured again when it changed,
+     * the status is aligned to the right of the bar */
+    Bool changed[LENGTH(m->segs)];
+    int x0 = m->w, x1 = 0;
+    for (unsigned int i = 0, x = 0; i < LENGTH(segs); i++) {
+        Segment *s = &segs[i], *o = &m->segs[i];
+        size_t len = strlen(s->text);
+        s->w = !strcmp(s->text, o->text) && o->x >= 0 ? o->w:len ? XTextWidth(barfont, s->text, len) + 2*pad:0;
+        s->x = i < LENGTH(segs) - 1 ? (int)x:m->w > s->w ? m->w - s->w:0;
+        x += s->w;
+        if (!(changed[i] = s->x != o->x || s->w != o->w || s->fg != o->fg || s->bg != o->bg || strcmp(s->text, o->text)))
+            continue;
+        if (o->x < 0 || o->w <= 0) continue;
+        XSetForeground(dis, bargc, bar_bg);
+        XFillRectangle(dis, m->buf, bargc, o->x, 0, o->w, PANEL_HEIGHT);
+        if (o->x < x0) x0 = o->x;
+        if (o->x + o->w > x1) x1 = o->x + o->w;
+    }
+    /* a wide status is drawn over the desktops, so a segment that the old
+     * or new span of a changed one overlaps is drawn again, in order */
+    for (Bool more = True; more;) {
+        more = False;
+        for (unsigned int i = 0; i < LENGTH(segs); i++) for (unsigned int j = 0; j < LENGTH(segs) && !changed[i]; j++) {
+            const Segment *s = &segs[i], *n = &segs[j], *o = &m->segs[j];
+            if (!changed[j] || s->w <= 0) continue;
+            if ((n->w > 0 && n->x < s->x + s->w && s->x < n->x + n->w)
+             || (o->x >= 0 && o->w > 0 && o->x < s->x + s->w && s->x < o->x + o->w)) changed[i] = more = True;
+        }
+    }
+    for (unsigned int i = 0; i < LENGTH(segs); i++) {
+        Segment *s = &segs[i];
+        if (!changed[i]) continue;
+        m->segs[i] = *s;
+        if (s->w <= 0) continue;
+        XSetForeground(dis, bargc, s->bg);
+        XFillRectangle(dis, m->buf, bargc, s->x, 0, s->w, PANEL_HEIGHT);
+        XSetForeground(dis, bargc, s->fg);
+        XDrawString(dis, m->buf, bargc, s->x + pad, (PANEL_HEIGHT - fh)/2 + barfont->ascent, s->text, strlen(s->text));
+        if (s->x < x0) x0 = s->x;
+        if (s->x + s->w > x1) x1 = s->x + s->w;
+    }
+    if (x1 > m->w) x1 = m->w;
+    if (x0 < x1) XCopyArea(dis, m->buf, m->bar, bargc, x0, 0, x1 - x0, PANEL_HEIGHT, x0, 0);
+}
+
+/**
+ * query the monitors from xinerama and update the monitors array
+ *
+ * monitors are matched by their index. new monitors get the
+ * configured desktops and layouts, and the clients of removed
+ * monitors move to the same desktop of the last remaining monitor.
+ *
+ * the offsets used to hide windows are recomputed from the last
+ * monitor, and windows already hidden are moved by the difference.
+ * only the monitors that changed, or received clients, are tiled.
+ */
+void updategeom(void) {
+    int n = 0, ox = off_x, oy = off_y;
+    XineramaScreenInfo *info = XineramaQueryScreens(dis, &n);
+
+    if (!n || !info) {
+        if (!monitors) errx(EXIT_FAILURE, "Xinerama is not active");
+        if (info) XFree(info);
+        return;
+    }
+
+    /* move the clients of removed monitors to the last remaining monitor */
+    for (int cm = n; cm < nmonitors; cm++) freebar(&monitors[cm]);
+    for (int cm = n; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) {
+        Monitor *m = &monitors[cm], *nm = &monitors[n - 1];
+        Desktop *d = &m->desktops[cd], *nd = &nm->desktops[cd];
+        for (Client *c = d->head; c; c = d->head) {
+            detach(c, d);
+            if (ISFFT(c)) c->isfloat = c->isfull = False;
+            if (cd == m->currdeskidx && cd != nm->currdeskidx) hide(c);
+            else if (cd != m->currdeskidx && cd == nm->currdeskidx) show(c);
+            c->mon = n - 1; c->pos = -1;
+            attach(c, NULL, nd);
+        }
+        if (nd->head) focus(nd->curr ? nd->curr:nd->head, nd, nm);
+        tile(nd, nm);
+    }
+
+    Monitor *mons = realloc(monitors, n * sizeof(Monitor));
+    if (!mons) err(EXIT_FAILURE, "cannot allocate monitors");
+    monitors = mons;
+
+    for (int cm = nmonitors; cm < n; cm++) {
+        const int *layout = NULL;
+        Bool sbar         = SHOW_PANEL;
+
+        if ((int)LENGTH(monitorcfg) > cm) {
+            layout = monitorcfg[cm].layout;
+            sbar   = monitorcfg[cm].sbar;
+        }
+        memset(&monitors[cm], 0, sizeof(Monitor));
+        for (unsigned int d = 0; d < DESKTOPS; d++) {
+            /* no value was output about a new desktop, so its first info is complete */
+            monitors[cm].desktops[d] = (Desktop){ .mode = DEFAULT_MODE, .sbar = sbar, .info = { -1 } };
+            if (layout && layout[d] != -1) monitors[cm].desktops[d].mode = layout[d];
+            else layout = NULL;
+        }
+    }
+
+    for (int cm = 0; cm < n; cm++) {
+        Monitor *m = &monitors[cm];
+        if (cm >= nmonitors || m->x != info[cm].x_org || m->y != info[cm].y_org
+                            || m->w != info[cm].width || m->h != info[cm].height) {
+            m->x = info[cm].x_org; m->y = info[cm].y_org; m->w = info[cm].width; m->h = info[cm].height;
+            tile(&m->desktops[m->currdeskidx], m);
+            freebar(m);
+        }
+        for (int cd = 0; cd < DESKTOPS; cd++) m->desktops[cd].info[0] = -1; /* output all desktops */
+    }
+    XFree(info);
+
+    nmonitors = n;
+    if (currmonidx >= nmonitors) currmonidx = nmonitors - 1;
+    off_x = 2 * (monitors[nmonitors - 1].x + monitors[nmonitors - 1].w);
+    off_y = 2 * (monitors[nmonitors - 1].y + monitors[nmonitors - 1].h);
+
+    for (int cm = 0; cm < nmonitors; cm++) {
+        Monitor *m = &monitors[cm]; Desktop *d = &m->desktops[m->currdeskidx];
+        for (int cd = 0; cd < DESKTOPS; cd++) for (Client *c = m->desktops[cd].head; c; c = c->next) {
+            if (!UNMAP_HIDDEN && cd != m->currdeskidx && (ox != off_x || oy != off_y))
+                MV(c, c->x - ox + off_x, c->y - oy + off_y);
+            if (d->dirty && c->isfull) setfullscreen(c, &m->desktops[cd], m, True);
+        }
+        if (d->dirty && d->head) focus(d->curr ? d->curr:d->head, d, m);
+    }
+    dirtyinfo = True;
 }
 
 /**
  * find to which client and desktop the given window belongs to
+ *
+ * the client is looked up in the window context table,
+ * the monitor and desktop are found by the client's indices
  */
 Bool wintoclient(Window w, Client **c, Desktop **d, Monitor **m) {
-    for (int cm = 0; cm < nmonitors && !*c; cm++)
-        for (int cd = 0; cd < DESKTOPS && !*c; cd++)
-            for (*m = &monitors[cm], *d = &(*m)->desktops[cd], *c = (*d)->head; *c && (*c)->win != w; *c = (*c)->next);
+    if (XFindContext(dis, w, clientctx, (XPointer *)c)) *c = NULL;
+    else *d = &(*m = &monitors[(*c)->mon])->desktops[(*c)->desk];
+#ifdef DEBUG
+    if (*c) stats.hits++; else stats.misses++;
+#endif
     return (*c != NULL);
 }
 
@@ -1463,8 +3187,11 @@ int main(int argc, char *argv[]) {
     setup();
     desktopinfo(); /* zero out every desktop on (re)start */
     run();
+    if (restarting) savestate();
     cleanup();
     XCloseDisplay(dis);
+    if (restarting) execvp(argv[0], argv);
+    if (restarting) err(EXIT_FAILURE, "cannot restart %s", argv[0]);
     return retval;
 }
 
@@ -0,0 +1,184 @@
+/* see LICENSE for copyright and license
+ *
+ * checks the client list operations against an array of the windows
+ * in the order they should be in, on random sequences of move_up,
+ * move_down, swap_master, prev_win, next_win, client_to_desktop and
+ * windows mapped and destroyed, with the wm on a fake display (see
+ * fakex.h), and with "bench" times the previous client lookup and
+ * the list operations for 10, 100 and 1000 clients
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include "fakex.h"
+
+#define MAXN 1000
+
+static Window order[MAXN + 1];
+static int norder;
+
+static void (*const ops[])(void) = { move_up, move_down, swap_master, prev_win, next_win };
+static const char *opnames[] = { "move_up", "move_down", "swap_master", "prev_win", "next_win" };
+
+/**
+ * the index of the current client of the first desktop in the array
+ */
+static int current(void) {
+    const Desktop *d = &monitors[0].desktops[0];
+    int i = 0;
+    while (i < norder && (!d->curr || order[i] != d->curr->win)) i++;
+    return i;
+}
+
+/**
+ * apply operation op to the array, as it should be applied to the list
+ */
+static void model(int op) {
+    int i = current(), n = norder;
+    Window c = order[i];
+    if (n < 2 || i == n) return;
+    if (ops[op] == move_down && i < n - 1) { order[i] = order[i + 1]; order[i + 1] = c; }
+    else if (ops[op] == move_down) { memmove(order + 1, order, (n - 1) * sizeof(Window)); order[0] = c; }
+    else if (ops[op] == move_up && i > 0) { order[i] = order[i - 1]; order[i - 1] = c; }
+    else if (ops[op] == move_up) { memmove(order, order + 1, (n - 1) * sizeof(Window)); order[n - 1] = c; }
+    else if (ops[op] == swap_master && i == 0) { order[0] = order[1]; order[1] = c; }
+    else if (ops[op] == swap_master) { memmove(order + 1, order, i * sizeof(Window)); order[0] = c; }
+}
+
+/**
+ * the window that should be current after operation op was applied to
+ * the array, given the current window c at index i before it
+ */
+static Window focused(int op, int i, Window c) {
+    int n = norder;
+    if (n < 2) return c;
+    if (ops[op] == next_win) return order[(i + 1) % n];
+    if (ops[op] == prev_win) return order[(i + n - 1) % n];
+    if (ops[op] == swap_master) return order[0];
+    return c;
+}
+
+/**
+ * compare the client list of desktop d with n windows of w,
+ * and check that it is linked both ways and counted
+ */
+static Bool same(const Desktop *d, const Window *w, int n, char *why, size_t size) {
+    const Client *c = d->head, *last = NULL;
+    int i = 0;
+    for (; c && i < n; last = c, c = c->next, i++) {
+        if (c->win != w[i]) { snprintf(why, size, "client %d is 0x%lx, not 0x%lx", i, c->win, w[i]); return False; }
+        if (c != d->head && c->prev != last) { snprintf(why, size, "client %d does not link back", i); return False; }
+    }
+    if (c || i != n) snprintf(why, size, "the list has %s clients than %d", c ? "more":"fewer", n);
+    else if (d->head && d->head->prev != last) snprintf(why, size, "the head does not link to the last client");
+    else if (d->count != n) snprintf(why, size, "the desktop counts %d clients, not %d", d->count, n);
+    else return True;
+    return False;
+}
+
+/**
+ * the previous client the way it was found before the list was linked
+ * both ways, walking from the head
+ */
+static Client *walkprev(Client *c, Desktop *d) {
+    Client *p = d->head;
+    if (!c || !d->head->next) return NULL;
+    while (p->next && p->next != c) p = p->next;
+    return p;
+}
+
+/**
+ * map n windows, a few at a time as each one retiles the desktop
+ */
+static void addclients(int n) {
+    for (int i = 0; i < n; i++) {
+        fakemap((order[norder++] = fakewindow(0, 0, 640, 480, "client\0Client")));
+        if (i % 10 == 9 || i == n - 1) fakebatch();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    unsigned int runs = 0, bad = 0, moved = 0;
+    Window other[MAXN];
+    char why[128];
+
+    fakemonitors(&(XineramaScreenInfo){ 0, 0, 0, 1920, 1080 }, 1);
+    fakeopen();
+    srand(1);
+    for (int k = 0; k < 20000 && bad < 10; k++, runs++) {
+        const Desktop *d = &monitors[0].desktops[0];
+        int r = rand() % 100, op = rand() % LENGTH(ops), i = current();
+        Window w = 0;
+        const char *what = opnames[op];
+        if (r < 8 && norder < 64) { addclients(1); what = "map"; w = order[norder - 1]; }
+        else if (r < 12 && norder) {
+            int j = rand() % norder;
+            fakedestroy(order[j]); fakebatch();
+            memmove(order + j, order + j + 1, (--norder - j) * sizeof(Window));
+            what = "destroy";
+        } else if (r < 14 && i < norder && moved < MAXN) {
+            client_to_desktop(&(Arg){.i = 1}); fakebatch();
+            other[moved++] = order[i];
+            memmove(order + i, order + i + 1, (--norder - i) * sizeof(Window));
+            what = "client_to_desktop";
+        } else {
+            Window c = i < norder ? order[i]:0;
+            model(op);
+            w = c ? focused(op, i, c):0;
+            ops[op](); fakebatch();
+        }
+        if (!same(d, order, norder, why, sizeof(why))
+         || !same(&monitors[0].desktops[1], other, moved, why, sizeof(why))) {
+            fprintf(stderr, "clients: after %s with %d clients: %s\n", what, norder, why);
+            bad++;
+        } else if (w && (!d->curr || d->curr->win != w)) {
+            fprintf(stderr, "clients: after %s with %d clients: 0x%lx is focused, not 0x%lx\n",
+                    what, norder, d->curr ? d->curr->win:0, w);
+            bad++;
+        } else if (d->curr && d->prev == d->curr) {
+            fprintf(stderr, "clients: after %s with %d clients: the previous client is the current\n", what, norder);
+            bad++;
+        }
+    }
+    fprintf(fakeout, "clients: %u operations, %u wrong\n", runs, bad);
+
+    for (int n = 10; bench && n <= MAXN; n *= 10) {
+        Monitor *m = &monitors[0]; Desktop *d = &m->desktops[0];
+        while (norder) { fakedestroy(order[--norder]); }
+        fakebatch();
+        addclients(n);
+        const int calls = 1000000/n + 1000;
+        Client *volatile p = NULL;
+        double t0 = now();
+        for (int k = 0; k < calls; k++) p = prevclient(d->curr = d->head->prev, d);
+        double t1 = now();
+        for (int k = 0; k < calls; k++) p = walkprev(d->curr = d->head->prev, d);
+        double t2 = now();
+        (void)p;
+        fprintf(fakeout, "clients: %4d clients, prevclient %.0f ns, walking from the head %.0f ns\n",
+                n, (t1 - t0) * 1e9 / calls, (t2 - t1) * 1e9 / calls);
+
+        /* the operations are timed without the batches that
+         * handle the events they cause, every 100 operations */
+        fprintf(fakeout, "clients: %4d clients,", n);
+        for (unsigned int op = 0; op < LENGTH(ops); op++) {
+            unsigned long reqs = 0;
+            double t = 0;
+            focus(d->head->next, d, m); fakebatch();
+            for (int k = 0; k < calls; k += 100) {
+                unsigned long r0 = fakereqs;
+                t0 = now();
+                for (int j = 0; j < 100; j++) ops[op]();
+                t += now() - t0;
+                reqs += fakereqs - r0;
+                fakebatch();
+            }
+            fprintf(fakeout, " %s %.0f ns %.1f requests%s", opnames[op], t * 1e9 / calls,
+                    (double)reqs / calls, op + 1 < LENGTH(ops) ? ",":"\n");
+        }
+    }
+    fakeclose();
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+/* see LICENSE for copyright and license
+ *
+ * checks that the windows of the shown desktop are on screen and those
+ * of the other desktops hidden, on random sequences of desktop switches
+ * and windows mapped and destroyed, with the wm on a fake display (see
+ * fakex.h), and with "bench" times a desktop switch and counts the
+ * requests it sends, with 1, 10, 100 and 1000 windows on each desktop
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include "fakex.h"
+
+#define MAXN 1000
+
+/**
+ * check that the clients of the desktops of the first monitor are
+ * shown or hidden, the way hide() and show() leave them
+ */
+static Bool visible(char *why, size_t size) {
+    const Monitor *m = &monitors[0];
+    for (int i = 0; i < DESKTOPS; i++) for (const Client *c = m->desktops[i].head; c; c = c->next) {
+        const FakeWin *f = &fakewins[c->win];
+        const Bool shown = f->mapped && f->x < m->x + m->w && f->y < m->y + m->h;
+        if (shown == (i == m->currdeskidx)) continue;
+        snprintf(why, size, "window 0x%lx of desktop %d is %s while desktop %d is shown",
+                 c->win, i, shown ? "shown":"hidden", m->currdeskidx);
+        return False;
+    }
+    return True;
+}
+
+/**
+ * map n windows on the current desktop, a few at a time
+ * as each one retiles the desktop
+ */
+static void addclients(int n) {
+    for (int i = 0; i < n; i++) {
+        fakemap(fakewindow(0, 0, 640, 480, "client\0Client"));
+        if (i % 10 == 9 || i == n - 1) fakebatch();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    unsigned int runs = 0, bad = 0;
+    char why[160];
+
+    fakemonitors(&(XineramaScreenInfo){ 0, 0, 0, 1920, 1080 }, 1);
+    fakeopen();
+    srand(1);
+    for (int k = 0; k < 20000 && bad < 10; k++, runs++) {
+        const Monitor *m = &monitors[0];
+        const Desktop *d = &m->desktops[m->currdeskidx];
+        int r = rand() % 100;
+        const char *what = "change_desktop";
+        if (r < 20 && d->count < 16) { addclients(1 + rand() % 3); what = "map"; }
+        else if (r < 30 && d->head) {
+            const Client *c = d->head;
+            for (int j = rand() % d->count; j > 0; j--) c = c->next;
+            fakedestroy(c->win); fakebatch();
+            what = "destroy";
+        } else { change_desktop(&(Arg){.i = rand() % DESKTOPS}); fakebatch(); }
+        if (!visible(why, sizeof(why))) {
+            fprintf(stderr, "desktops: after %s: %s\n", what, why);
+            bad++;
+        }
+    }
+    fprintf(fakeout, "desktops: %u operations, %u wrong\n", runs, bad);
+
+    for (int n = 1; bench && n <= MAXN; n *= 10) {
+        Monitor *m = &monitors[0];
+        for (int i = 0; i < DESKTOPS; i++) while (m->desktops[i].head) fakedestroy(m->desktops[i].head->win), fakebatch();
+        for (int i = 1; i >= 0; i--) { change_desktop(&(Arg){.i = i}); fakebatch(); addclients(n); }
+
+        /* a switch is timed with the batch that handles the events
+         * it causes, as the desktop is tiled at the end of the batch */
+        const int calls = 10000/n + 10;
+        unsigned long reqs = 0, trips = 0;
+        double t = 0;
+        for (int k = 0; k < calls; k++) {
+            unsigned long r0 = fakereqs, t0 = faketrips;
+            double s = now();
+            change_desktop(&(Arg){.i = !m->currdeskidx}); fakebatch();
+            t += now() - s;
+            reqs += fakereqs - r0; trips += faketrips - t0;
+        }
+        if (!visible(why, sizeof(why))) { fprintf(stderr, "desktops: after %d switches: %s\n", calls, why); bad++; }
+        fprintf(fakeout, "desktops: %4d windows %s, switch %.1f us, %.1f requests, %.1f round trips\n",
+                n, UNMAP_HIDDEN ? "unmapped":"moved off screen", t * 1e6 / calls,
+                (double)reqs / calls, (double)trips / calls);
+    }
+    fakeclose();
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
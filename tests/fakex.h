@@ -0,0 +1,885 @@
+/* see LICENSE for copyright and license
+ *
+ * a fake display for the tests that run the wm as a whole, included
+ * after monsterwm.c. it stands in for xlib, xcb, xinerama and randr, so the
+ * tests need no X server and link none of the X libraries
+ *
+ * the display is a table of top level windows, with their geometry,
+ * map state, event mask and properties, and a queue of the events
+ * for the wm. requests are applied to the table as they are sent and
+ * counted in fakereqs, and the events a server sends a wm about them
+ * are queued, as the unmap notification of a window the wm unmapped.
+ * a request that waits for its reply counts a round trip in faketrips,
+ * and so does waiting for an xcb reply to a request sent since the
+ * last round trip. the connection is readable while events are queued.
+ *
+ * the test plays the clients: it creates windows with fakewindow and
+ * asks to map or destroy them with fakemap and fakedestroy, and lets
+ * the wm handle what is queued with fakebatch, which runs run() until
+ * the wm is idle. the output of the wm is sent to /dev/null, and the
+ * test prints its results to fakeout instead.
+ */
+
+#include <X11/Xresource.h>
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#define FAKEWINS    (1 << 14)
+#define FAKEPROPS   8
+#define FAKEQUEUE   (1 << 16)
+#define FAKEREPLIES (1 << 16)
+#define FAKEROOT    1
+#define FAKERANDR   100
+
+/**
+ * a property of a window, format 32 items are kept as longs as xlib does
+ */
+typedef struct {
+    Atom name, type;
+    int format;
+    unsigned long n;
+    unsigned char *data;
+} FakeProp;
+
+/**
+ * a window of the fake display
+ *
+ * own  - whether the wm created the window, it is destroyed when the wm disconnects
+ * mask - the events the wm selected on the window
+ */
+typedef struct {
+    Bool used, mapped, override, own;
+    int x, y, w, h, bw;
+    long mask;
+    FakeProp props[FAKEPROPS];
+} FakeWin;
+
+static FakeWin fakewins[FAKEWINS];
+/* the contexts are kept by xlib, so they outlive the windows */
+static struct { XContext ctx; XPointer data; } fakectx[FAKEWINS];
+static Window fakenext = FAKEROOT + 1, fakefocus;
+static XEvent fakequeue[FAKEQUEUE];
+static unsigned int fakehead, faketail;
+static void *fakereplies[FAKEREPLIES];
+static unsigned long fakereqs, faketrips, fakesynced, fakeerrors;
+static char *fakeatoms[256];
+static unsigned int nfakeatoms;
+static XineramaScreenInfo fakescreens[16];
+static int nfakescreens, fakerandr;
+static XErrorHandler fakehandler;
+static XrmQuark fakequark;
+static int fakepipe[2] = { -1, -1 }, fakeidle;
+static Bool fakeready, fakestop, fakebatching;
+static char fakedir[] = "/tmp/monsterwm-test.XXXXXX";
+static FILE *fakeout;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * the window, or NULL if there is no such window, which is an error
+ */
+static FakeWin *fakewin(Window w) {
+    if (w > 0 && w < FAKEWINS && fakewins[w].used) return &fakewins[w];
+    fakeerrors++;
+    return NULL;
+}
+
+static FakeProp *fakeprop(FakeWin *f, Atom name) {
+    for (int i = 0; f && i < FAKEPROPS; i++) if (f->props[i].name == name) return &f->props[i];
+    return NULL;
+}
+
+static void fakerequest(void) {
+    fakereqs++;
+}
+
+static void fakeroundtrip(void) {
+    fakereqs++; faketrips++;
+    fakesynced = fakereqs;
+}
+
+/**
+ * make the connection readable while events are queued,
+ * or once the batch is over (see fakebatch)
+ */
+static void fakesignal(void) {
+    Bool ready = fakehead < faketail || fakestop;
+    char ch = 0;
+    if (ready && !fakeready && write(fakepipe[1], &ch, 1) == 1) fakeready = True;
+    else if (!ready && fakeready && read(fakepipe[0], &ch, 1) == 1) fakeready = False;
+}
+
+static void fakepush(const XEvent *e) {
+    if (faketail == FAKEQUEUE && fakehead) {
+        memmove(fakequeue, fakequeue + fakehead, (faketail - fakehead) * sizeof(XEvent));
+        faketail -= fakehead; fakehead = 0;
+    }
+    if (faketail == FAKEQUEUE) errx(EXIT_FAILURE, "fakex: the event queue is full");
+    fakequeue[faketail++] = *e;
+    fakesignal();
+}
+
+static void fakeremove(unsigned int i) {
+    if (i == fakehead) fakehead++;
+    else memmove(fakequeue + i, fakequeue + i + 1, (--faketail - i) * sizeof(XEvent));
+    if (fakehead == faketail) fakehead = faketail = 0;
+    fakesignal();
+}
+
+/**
+ * queue a notification about a top level window, if the wm selected it on the root
+ */
+static void fakenotify(int type, Window w) {
+    FakeWin *f = &fakewins[w];
+    XEvent ev = { .type = type };
+    if (!dis || !(fakewins[FAKEROOT].mask & SubstructureNotifyMask)) return;
+    switch (type) {
+        case MapNotify:       ev.xmap = (XMapEvent){ .type = type, .event = FAKEROOT, .window = w }; break;
+        case UnmapNotify:     ev.xunmap = (XUnmapEvent){ .type = type, .event = FAKEROOT, .window = w }; break;
+        case DestroyNotify:   ev.xdestroywindow = (XDestroyWindowEvent){ .type = type, .event = FAKEROOT, .window = w }; break;
+        case ConfigureNotify: ev.xconfigure = (XConfigureEvent){ .type = type, .event = FAKEROOT, .window = w,
+                                  .x = f->x, .y = f->y, .width = f->w, .height = f->h, .border_width = f->bw }; break;
+    }
+    fakepush(&ev);
+}
+
+static void fakeset(Window w, Atom name, Atom type, int format, const void *data, unsigned long n) {
+    FakeWin *f = fakewin(w);
+    FakeProp *p = fakeprop(f, name);
+    size_t size = n * (format == 32 ? sizeof(long):(size_t)format/8);
+    if (!f) return;
+    if (!p && !(p = fakeprop(f, None))) errx(EXIT_FAILURE, "fakex: too many properties on 0x%lx", w);
+    free(p->data);
+    *p = (FakeProp){ name, type, format, n, malloc(size + 1) };
+    if (!p->data) err(EXIT_FAILURE, "fakex");
+    memcpy(p->data, data, size);
+    p->data[size] = '\0';
+    if (dis && f->mask & PropertyChangeMask) {
+        XEvent ev = { .xproperty = { .type = PropertyNotify, .window = w, .atom = name, .state = PropertyNewValue } };
+        fakepush(&ev);
+    }
+}
+
+static void fakedelete(FakeWin *f, Atom name) {
+    FakeProp *p = name ? fakeprop(f, name):NULL;
+    if (!p) return;
+    free(p->data);
+    *p = (FakeProp){ 0 };
+}
+
+/**
+ * the screens xinerama reports, and the root window covering them
+ *
+ * once the wm runs, the change is notified as the server does: randr
+ * notifies a change of each screen's crtc and output, and the root
+ * window and randr notify a change of the root window's size
+ */
+static void fakemonitors(const XineramaScreenInfo *s, int n) {
+    FakeWin *r = &fakewins[FAKEROOT];
+    const int w = r->w, h = r->h;
+    memcpy(fakescreens, s, n * sizeof(*s));
+    nfakescreens = n;
+    r->used = r->mapped = True;
+    r->w = r->h = 0;
+    for (int i = 0; i < n; i++) {
+        if (s[i].x_org + s[i].width > r->w) r->w = s[i].x_org + s[i].width;
+        if (s[i].y_org + s[i].height > r->h) r->h = s[i].y_org + s[i].height;
+    }
+    if (!dis) return;
+    for (int i = 0; i < n; i++) for (int k = RRNotify_CrtcChange; k <= RRNotify_OutputChange; k++) {
+        XEvent ev = { .type = FAKERANDR + RRNotify };
+        ((XRRNotifyEvent *)&ev)->subtype = k;
+        if (fakerandr & (k == RRNotify_CrtcChange ? RRCrtcChangeNotifyMask:RROutputChangeNotifyMask)) fakepush(&ev);
+    }
+    if (r->w == w && r->h == h) return;
+    if (fakerandr & RRScreenChangeNotifyMask) fakepush(&(XEvent){ .type = FAKERANDR + RRScreenChangeNotify });
+    if (r->mask & StructureNotifyMask) fakepush(&(XEvent){ .xconfigure = { .type = ConfigureNotify,
+                                                .event = FAKEROOT, .window = FAKEROOT, .width = r->w, .height = r->h } });
+}
+
+/**
+ * create an unmapped top level window of a client, with the given class
+ */
+static Window fakewindow(int x, int y, int w, int h, const char *class) {
+    Window win = fakenext++;
+    if (win >= FAKEWINS) errx(EXIT_FAILURE, "fakex: too many windows");
+    fakewins[win] = (FakeWin){ .used = True, .x = x, .y = y, .w = w, .h = h };
+    if (class) fakeset(win, XA_WM_CLASS, XA_STRING, 8, class, strlen(class) + 1);
+    return win;
+}
+
+/**
+ * a client maps its window, which the wm is asked to do if it redirects the root
+ */
+static void fakemap(Window w) {
+    FakeWin *f = fakewin(w);
+    if (!f || f->mapped) return;
+    if (dis && fakewins[FAKEROOT].mask & SubstructureRedirectMask && !f->override) {
+        XEvent ev = { .xmaprequest = { .type = MapRequest, .parent = FAKEROOT, .window = w } };
+        fakepush(&ev);
+    } else {
+        f->mapped = True;
+        fakenotify(MapNotify, w);
+    }
+}
+
+/**
+ * a client destroys its window
+ */
+static void fakedestroy(Window w) {
+    FakeWin *f = fakewin(w);
+    if (!f) return;
+    if (f->mapped) fakenotify(UnmapNotify, w);
+    fakenotify(DestroyNotify, w);
+    for (int i = 0; i < FAKEPROPS; i++) free(f->props[i].data);
+    *f = (FakeWin){ 0 };
+}
+
+static void fakermdir(void) {
+    rmdir(fakedir);
+}
+
+/**
+ * start the wm on the fake display, as main does
+ *
+ * the runtime files of the wm are made in a directory of the test,
+ * and the desktop info the wm outputs is sent to /dev/null
+ */
+static void fakeopen(void) {
+    if (!fakeout) {
+        if (!mkdtemp(fakedir)) err(EXIT_FAILURE, "fakex: mkdtemp");
+        atexit(fakermdir);
+        setenv("XDG_RUNTIME_DIR", fakedir, 1);
+        if (!(fakeout = fdopen(dup(STDOUT_FILENO), "w")) || !freopen("/dev/null", "w", stdout)) err(EXIT_FAILURE, "fakex");
+        setvbuf(fakeout, NULL, _IOLBF, 0);
+    }
+    if (!(dis = XOpenDisplay(NULL))) errx(EXIT_FAILURE, "fakex: cannot open display");
+    setup();
+    desktopinfo();
+}
+
+/**
+ * stop the wm, as main does, and reset its globals to start it again
+ */
+static void fakeclose(void) {
+    if (restarting) savestate();
+    cleanup();
+    XCloseDisplay(dis);
+    dis = NULL;
+    running = True; dirtyinfo = restarting = False;
+    nmonitors = off_x = off_y = currmonidx = retval = 0;
+    numlockmask = 0;
+    monitors = NULL; chunks = NULL; pool = NULL; patterns = NULL; states = NULL; moves = NULL; rects = NULL; nrects = 0;
+    memset(roots, 0, sizeof(roots)); memset(hasrules, 0, sizeof(hasrules));
+    barfont = NULL; bargc = NULL;
+    ipcfd = statusfd = -1; statuslen = 0; statusskip = False; status[0] = '\0';
+}
+
+/**
+ * let the wm handle the events queued so far and those that follow
+ * from them, until the queue is drained after the end of a batch
+ */
+static void fakebatch(void) {
+    fakebatching = True; fakeidle = 0;
+    run();
+    fakebatching = fakestop = False; running = True;
+    fakesignal();
+}
+
+/* xlib */
+
+Display *XOpenDisplay(_Xconst char *name) {
+    _XPrivDisplay d = calloc(1, sizeof(*d));
+    Screen *s = calloc(1, sizeof(*s));
+    if (!d || !s || pipe(fakepipe)) err(EXIT_FAILURE, "fakex");
+    s->root = FAKEROOT; s->root_depth = 24; s->cmap = 1;
+    d->fd = fakepipe[0]; d->display_name = ":fake"; d->nscreens = 1; d->screens = s;
+    fakewins[FAKEROOT].used = fakewins[FAKEROOT].mapped = True;
+    fakeready = fakestop = False;
+    return (Display *)d;
+}
+
+int XCloseDisplay(Display *dpy) {
+    _XPrivDisplay d = (_XPrivDisplay)dpy;
+    for (Window w = 0; w < fakenext; w++) {
+        if (fakewins[w].own) fakedestroy(w);
+        fakewins[w].mask = 0;
+    }
+    memset(fakectx, 0, sizeof(fakectx));
+    fakehead = faketail = fakerandr = 0;
+    close(fakepipe[0]); close(fakepipe[1]);
+    free(d->screens); free(d);
+    return 0;
+}
+
+int XPending(Display *dpy) {
+    int n = faketail - fakehead;
+    if (n) fakeidle = 0;
+    else if (fakebatching && ++fakeidle == 2) { running = False; fakestop = True; fakesignal(); }
+    return ((_XPrivDisplay)dpy)->qlen = n;
+}
+
+int XNextEvent(Display *dpy, XEvent *ev) {
+    if (fakehead == faketail) errx(EXIT_FAILURE, "fakex: XNextEvent would wait for an event");
+    *ev = fakequeue[fakehead];
+    fakeremove(fakehead);
+    ((_XPrivDisplay)dpy)->qlen = faketail - fakehead;
+    return 0;
+}
+
+int XPeekEvent(Display *dpy, XEvent *ev) {
+    if (fakehead == faketail) errx(EXIT_FAILURE, "fakex: XPeekEvent would wait for an event");
+    *ev = fakequeue[fakehead];
+    return 0;
+}
+
+Bool XCheckIfEvent(Display *dpy, XEvent *ev, Bool (*pred)(Display *, XEvent *, XPointer), XPointer arg) {
+    for (unsigned int i = fakehead; i < faketail; i++) if (pred(dpy, &fakequeue[i], arg)) {
+        *ev = fakequeue[i];
+        fakeremove(i);
+        ((_XPrivDisplay)dpy)->qlen = faketail - fakehead;
+        return True;
+    }
+    return False;
+}
+
+static long fakemask(int type) {
+    switch (type) {
+        case ButtonPress:      return ButtonPressMask;
+        case ButtonRelease:    return ButtonReleaseMask;
+        case MotionNotify:     return PointerMotionMask;
+        case MapRequest:       /* fall through */
+        case ConfigureRequest: return SubstructureRedirectMask;
+    }
+    return 0;
+}
+
+Bool XCheckMaskEvent(Display *dpy, long mask, XEvent *ev) {
+    for (unsigned int i = fakehead; i < faketail; i++) if (fakemask(fakequeue[i].type) & mask) {
+        *ev = fakequeue[i];
+        fakeremove(i);
+        ((_XPrivDisplay)dpy)->qlen = faketail - fakehead;
+        return True;
+    }
+    return False;
+}
+
+int XMaskEvent(Display *dpy, long mask, XEvent *ev) {
+    if (!XCheckMaskEvent(dpy, mask, ev)) errx(EXIT_FAILURE, "fakex: XMaskEvent would wait for an event");
+    return 0;
+}
+
+int XSync(Display *dpy, Bool discard) {
+    fakeroundtrip();
+    return 1;
+}
+
+int XFlush(Display *dpy) {
+    return 1;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+    XErrorHandler old = fakehandler;
+    fakehandler = handler;
+    return old;
+}
+
+Atom XInternAtom(Display *dpy, _Xconst char *name, Bool only_if_exists) {
+    unsigned int i = 0;
+    fakeroundtrip();
+    while (i < nfakeatoms && strcmp(fakeatoms[i], name)) i++;
+    if (i == nfakeatoms && (only_if_exists || i == LENGTH(fakeatoms))) return None;
+    if (i == nfakeatoms && !(fakeatoms[nfakeatoms++] = strdup(name))) err(EXIT_FAILURE, "fakex");
+    return XA_LAST_PREDEFINED + 1 + i;
+}
+
+int XFree(void *data) {
+    free(data);
+    return 1;
+}
+
+int XSelectInput(Display *dpy, Window w, long mask) {
+    FakeWin *f = fakewin(w);
+    fakerequest();
+    if (f) f->mask = mask;
+    return 1;
+}
+
+int XChangeProperty(Display *dpy, Window w, Atom name, Atom type, int format, int mode,
+                    _Xconst unsigned char *data, int n) {
+    fakerequest();
+    fakeset(w, name, type, format, data, n);
+    return 1;
+}
+
+int XDeleteProperty(Display *dpy, Window w, Atom name) {
+    fakerequest();
+    fakedelete(fakewin(w), name);
+    return 1;
+}
+
+int XGetWindowProperty(Display *dpy, Window w, Atom name, long offset, long length, Bool delete, Atom req_type,
+                       Atom *type, int *format, unsigned long *n, unsigned long *after, unsigned char **data) {
+    FakeWin *f = fakewin(w);
+    FakeProp *p = fakeprop(f, name);
+    fakeroundtrip();
+    *type = None; *format = 0; *n = *after = 0; *data = NULL;
+    if (!f) return BadWindow;
+    if (!p) return Success;
+    *type = p->type; *format = p->format;
+    if (req_type != AnyPropertyType && req_type != p->type) { *after = p->n * p->format/8; return Success; }
+    size_t unit = p->format == 32 ? sizeof(long):(size_t)p->format/8;
+    *n = p->n < (unsigned long)length * 32/p->format ? p->n:(unsigned long)length * 32/p->format;
+    *after = (p->n - *n) * p->format/8;
+    if (!(*data = malloc(*n * unit + 1))) err(EXIT_FAILURE, "fakex");
+    memcpy(*data, p->data, *n * unit);
+    (*data)[*n * unit] = '\0';
+    if (delete && !*after) fakedelete(f, name);
+    return Success;
+}
+
+Status XGetTextProperty(Display *dpy, Window w, XTextProperty *text, Atom name) {
+    FakeProp *p = fakeprop(fakewin(w), name);
+    fakeroundtrip();
+    *text = (XTextProperty){ 0 };
+    if (!p || p->format != 8 || !(text->value = malloc(p->n + 1))) return 0;
+    memcpy(text->value, p->data, p->n + 1);
+    text->encoding = p->type; text->format = 8; text->nitems = p->n;
+    return 1;
+}
+
+int Xutf8TextPropertyToTextList(Display *dpy, const XTextProperty *text, char ***list, int *count) {
+    return XNoMemory;
+}
+
+int XmbTextPropertyToTextList(Display *dpy, const XTextProperty *text, char ***list, int *count) {
+    return XNoMemory;
+}
+
+void XFreeStringList(char **list) {
+}
+
+XWMHints *XGetWMHints(Display *dpy, Window w) {
+    FakeProp *p = fakeprop(fakewin(w), XA_WM_HINTS);
+    XWMHints *h = NULL;
+    fakeroundtrip();
+    if (p && p->format == 32 && p->n && (h = calloc(1, sizeof(*h)))) h->flags = ((long *)p->data)[0];
+    return h;
+}
+
+Status XGetWMNormalHints(Display *dpy, Window w, XSizeHints *hints, long *supplied) {
+    fakeroundtrip();
+    return 0;
+}
+
+Status XGetWMProtocols(Display *dpy, Window w, Atom **protocols, int *count) {
+    unsigned int i = 0;
+    while (i < nfakeatoms && strcmp(fakeatoms[i], "WM_PROTOCOLS")) i++;
+    FakeProp *p = i < nfakeatoms ? fakeprop(fakewin(w), XA_LAST_PREDEFINED + 1 + i):NULL;
+    fakeroundtrip();
+    if (!p || p->format != 32 || !(*protocols = malloc(p->n * sizeof(Atom) + 1))) return 0;
+    memcpy(*protocols, p->data, p->n * sizeof(Atom));
+    *count = p->n;
+    return 1;
+}
+
+Status XGetWindowAttributes(Display *dpy, Window w, XWindowAttributes *wa) {
+    FakeWin *f = fakewin(w);
+    fakeroundtrip();
+    if (!f) return 0;
+    *wa = (XWindowAttributes){ .x = f->x, .y = f->y, .width = f->w, .height = f->h, .border_width = f->bw,
+                               .root = FAKEROOT, .map_state = f->mapped ? IsViewable:IsUnmapped,
+                               .override_redirect = f->override };
+    return 1;
+}
+
+Status XQueryTree(Display *dpy, Window w, Window *root_return, Window *parent_return,
+                  Window **children, unsigned int *n) {
+    fakeroundtrip();
+    *root_return = FAKEROOT; *parent_return = None; *children = NULL; *n = 0;
+    if (w != FAKEROOT) return 0;
+    for (Window c = FAKEROOT + 1; c < fakenext; c++) *n += fakewins[c].used;
+    if (*n && !(*children = malloc(*n * sizeof(Window)))) err(EXIT_FAILURE, "fakex");
+    for (Window c = FAKEROOT + 1, i = 0; c < fakenext; c++) if (fakewins[c].used) (*children)[i++] = c;
+    return 1;
+}
+
+Bool XQueryPointer(Display *dpy, Window w, Window *root_return, Window *child, int *rx, int *ry,
+                   int *wx, int *wy, unsigned int *mask) {
+    fakeroundtrip();
+    return False;
+}
+
+Window XCreateWindow(Display *dpy, Window parent, int x, int y, unsigned int w, unsigned int h, unsigned int bw,
+                     int depth, unsigned int class, Visual *visual, unsigned long valuemask, XSetWindowAttributes *wa) {
+    Window win = fakewindow(x, y, w, h, NULL);
+    fakerequest();
+    fakewins[win].own = True;
+    fakewins[win].bw = bw;
+    fakewins[win].override = valuemask & CWOverrideRedirect && wa->override_redirect;
+    if (valuemask & CWEventMask) fakewins[win].mask = wa->event_mask;
+    return win;
+}
+
+int XDestroyWindow(Display *dpy, Window w) {
+    fakerequest();
+    if (fakewin(w)) fakedestroy(w);
+    return 1;
+}
+
+int XMapWindow(Display *dpy, Window w) {
+    FakeWin *f = fakewin(w);
+    fakerequest();
+    if (!f || f->mapped) return 1;
+    f->mapped = True;
+    fakenotify(MapNotify, w);
+    return 1;
+}
+
+int XMapRaised(Display *dpy, Window w) {
+    return XMapWindow(dpy, w);
+}
+
+int XUnmapWindow(Display *dpy, Window w) {
+    FakeWin *f = fakewin(w);
+    fakerequest();
+    if (!f || !f->mapped) return 1;
+    f->mapped = False;
+    fakenotify(UnmapNotify, w);
+    return 1;
+}
+
+int XConfigureWindow(Display *dpy, Window w, unsigned int mask, XWindowChanges *wc) {
+    FakeWin *f = fakewin(w);
+    fakerequest();
+    if (!f) return 1;
+    if (mask & CWX) f->x = wc->x;
+    if (mask & CWY) f->y = wc->y;
+    if (mask & CWWidth) f->w = wc->width;
+    if (mask & CWHeight) f->h = wc->height;
+    if (mask & CWBorderWidth) f->bw = wc->border_width;
+    fakenotify(ConfigureNotify, w);
+    return 1;
+}
+
+int XMoveWindow(Display *dpy, Window w, int x, int y) {
+    return XConfigureWindow(dpy, w, CWX|CWY, &(XWindowChanges){ .x = x, .y = y });
+}
+
+int XResizeWindow(Display *dpy, Window w, unsigned int width, unsigned int height) {
+    return XConfigureWindow(dpy, w, CWWidth|CWHeight, &(XWindowChanges){ .width = width, .height = height });
+}
+
+int XMoveResizeWindow(Display *dpy, Window w, int x, int y, unsigned int width, unsigned int height) {
+    return XConfigureWindow(dpy, w, CWX|CWY|CWWidth|CWHeight,
+                            &(XWindowChanges){ .x = x, .y = y, .width = width, .height = height });
+}
+
+int XSetWindowBorderWidth(Display *dpy, Window w, unsigned int width) {
+    return XConfigureWindow(dpy, w, CWBorderWidth, &(XWindowChanges){ .border_width = width });
+}
+
+int XSetWindowBorder(Display *dpy, Window w, unsigned long pixel) {
+    fakerequest();
+    fakewin(w);
+    return 1;
+}
+
+int XRaiseWindow(Display *dpy, Window w) {
+    fakerequest();
+    return 1;
+}
+
+int XRestackWindows(Display *dpy, Window *w, int n) {
+    fakereqs += n > 1 ? n - 1:0;
+    return 1;
+}
+
+int XSetInputFocus(Display *dpy, Window w, int revert_to, Time time) {
+    FakeWin *f = fakewin(w);
+    fakerequest();
+    if (!f || w == fakefocus) return 1;
+    fakefocus = w;
+    if (f->mask & FocusChangeMask) {
+        XEvent ev = { .xfocus = { .type = FocusIn, .window = w, .mode = NotifyNormal, .detail = NotifyNonlinear } };
+        fakepush(&ev);
+    }
+    return 1;
+}
+
+Status XSendEvent(Display *dpy, Window w, Bool propagate, long mask, XEvent *ev) {
+    fakerequest();
+    return 1;
+}
+
+int XKillClient(Display *dpy, XID resource) {
+    fakerequest();
+    return 1;
+}
+
+int XGrabKey(Display *dpy, int keycode, unsigned int modifiers, Window w, Bool owner_events,
+             int pointer_mode, int keyboard_mode) {
+    fakerequest();
+    return 1;
+}
+
+int XUngrabKey(Display *dpy, int keycode, unsigned int modifiers, Window w) {
+    fakerequest();
+    return 1;
+}
+
+int XGrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window w, Bool owner_events,
+                unsigned int mask, int pointer_mode, int keyboard_mode, Window confine_to, Cursor cursor) {
+    fakerequest();
+    return 1;
+}
+
+int XUngrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window w) {
+    fakerequest();
+    return 1;
+}
+
+int XGrabPointer(Display *dpy, Window w, Bool owner_events, unsigned int mask, int pointer_mode,
+                 int keyboard_mode, Window confine_to, Cursor cursor, Time time) {
+    fakeroundtrip();
+    return AlreadyGrabbed;
+}
+
+int XUngrabPointer(Display *dpy, Time time) {
+    fakerequest();
+    return 1;
+}
+
+int XWarpPointer(Display *dpy, Window src, Window dest, int sx, int sy, unsigned int sw, unsigned int sh,
+                 int dx, int dy) {
+    fakerequest();
+    return 1;
+}
+
+XModifierKeymap *XGetModifierMapping(Display *dpy) {
+    XModifierKeymap *m = calloc(1, sizeof(*m));
+    fakeroundtrip();
+    if (!m || !(m->modifiermap = calloc(8, sizeof(KeyCode)))) err(EXIT_FAILURE, "fakex");
+    m->max_keypermod = 1;
+    return m;
+}
+
+int XFreeModifiermap(XModifierKeymap *m) {
+    free(m->modifiermap);
+    free(m);
+    return 1;
+}
+
+KeyCode XKeysymToKeycode(Display *dpy, KeySym keysym) {
+    return 8 + keysym % 248;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev) {
+    return 1;
+}
+
+Status XAllocNamedColor(Display *dpy, Colormap map, _Xconst char *name, XColor *screen, XColor *exact) {
+    unsigned long pixel = 0;
+    fakeroundtrip();
+    while (*name) pixel = pixel * 31 + (unsigned char)*name++;
+    screen->pixel = exact->pixel = pixel & 0xffffff;
+    return 1;
+}
+
+XFontStruct *XLoadQueryFont(Display *dpy, _Xconst char *name) {
+    XFontStruct *f = calloc(1, sizeof(*f));
+    fakeroundtrip();
+    if (f) { f->fid = 1; f->ascent = 11; f->descent = 3; }
+    return f;
+}
+
+int XFreeFont(Display *dpy, XFontStruct *f) {
+    fakerequest();
+    free(f);
+    return 1;
+}
+
+int XTextWidth(XFontStruct *f, _Xconst char *s, int n) {
+    return 6 * n;
+}
+
+GC XCreateGC(Display *dpy, Drawable d, unsigned long mask, XGCValues *values) {
+    static char gc;
+    fakerequest();
+    return (GC)&gc;
+}
+
+int XFreeGC(Display *dpy, GC gc) {
+    fakerequest();
+    return 1;
+}
+
+int XSetFont(Display *dpy, GC gc, Font font) {
+    fakerequest();
+    return 1;
+}
+
+int XSetForeground(Display *dpy, GC gc, unsigned long pixel) {
+    fakerequest();
+    return 1;
+}
+
+Pixmap XCreatePixmap(Display *dpy, Drawable d, unsigned int w, unsigned int h, unsigned int depth) {
+    static Pixmap pixmaps = 1 << 30;
+    fakerequest();
+    return ++pixmaps;
+}
+
+int XFreePixmap(Display *dpy, Pixmap p) {
+    fakerequest();
+    return 1;
+}
+
+int XFillRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w, unsigned int h) {
+    fakerequest();
+    return 1;
+}
+
+int XDrawString(Display *dpy, Drawable d, GC gc, int x, int y, _Xconst char *s, int n) {
+    fakerequest();
+    return 1;
+}
+
+int XCopyArea(Display *dpy, Drawable src, Drawable dest, GC gc, int sx, int sy, unsigned int w, unsigned int h,
+              int dx, int dy) {
+    fakerequest();
+    return 1;
+}
+
+XrmQuark XrmUniqueQuark(void) {
+    return ++fakequark;
+}
+
+int XSaveContext(Display *dpy, XID rid, XContext ctx, _Xconst char *data) {
+    if (rid >= FAKEWINS) return XCNOMEM;
+    fakectx[rid].ctx = ctx; fakectx[rid].data = (XPointer)data;
+    return 0;
+}
+
+int XFindContext(Display *dpy, XID rid, XContext ctx, XPointer *data) {
+    if (rid >= FAKEWINS || fakectx[rid].ctx != ctx || !ctx) return XCNOENT;
+    *data = fakectx[rid].data;
+    return 0;
+}
+
+int XDeleteContext(Display *dpy, XID rid, XContext ctx) {
+    if (rid >= FAKEWINS || fakectx[rid].ctx != ctx || !ctx) return XCNOENT;
+    fakectx[rid].ctx = 0; fakectx[rid].data = NULL;
+    return 0;
+}
+
+/* xinerama */
+
+XineramaScreenInfo *XineramaQueryScreens(Display *dpy, int *n) {
+    XineramaScreenInfo *s = nfakescreens ? malloc(nfakescreens * sizeof(*s)):NULL;
+    fakeroundtrip();
+    *n = s ? nfakescreens:0;
+    if (s) memcpy(s, fakescreens, nfakescreens * sizeof(*s));
+    return s;
+}
+
+/* randr */
+
+Bool XRRQueryExtension(Display *dpy, int *event_base, int *error_base) {
+    fakeroundtrip();
+    *event_base = FAKERANDR; *error_base = FAKERANDR;
+    return True;
+}
+
+void XRRSelectInput(Display *dpy, Window w, int mask) {
+    fakerequest();
+    if (w == FAKEROOT) fakerandr = mask;
+}
+
+int XRRUpdateConfiguration(XEvent *ev) {
+    return 1;
+}
+
+/* xcb, the replies are made when the request is sent and kept by its sequence number */
+
+xcb_connection_t *XGetXCBConnection(Display *dpy) {
+    return (xcb_connection_t *)dpy;
+}
+
+static unsigned int fakecookie(void *reply) {
+    fakerequest();
+    free(fakereplies[fakereqs % FAKEREPLIES]);
+    fakereplies[fakereqs % FAKEREPLIES] = reply;
+    return fakereqs;
+}
+
+static void *fakereply(unsigned int sequence) {
+    void *r = fakereplies[sequence % FAKEREPLIES];
+    fakereplies[sequence % FAKEREPLIES] = NULL;
+    if (sequence > fakesynced) { faketrips++; fakesynced = fakereqs; }
+    return r;
+}
+
+xcb_get_property_cookie_t xcb_get_property(xcb_connection_t *c, uint8_t _delete, xcb_window_t window,
+                                           xcb_atom_t property, xcb_atom_t type, uint32_t long_offset,
+                                           uint32_t long_length) {
+    FakeWin *f = fakewin(window);
+    FakeProp *p = fakeprop(f, property);
+    unsigned long n = !p ? 0:p->n < long_length * 32/p->format ? p->n:long_length * 32/p->format;
+    xcb_get_property_reply_t *r = f ? calloc(1, sizeof(*r) + n * 4 + 1):NULL;
+    if (r && p) {
+        r->type = p->type; r->format = p->format;
+        if (type != XCB_GET_PROPERTY_TYPE_ANY && type != p->type) r->bytes_after = p->n * p->format/8;
+        else for (unsigned long i = 0; i < n; i++) {
+            r->value_len = n; r->bytes_after = (p->n - n) * p->format/8;
+            if (p->format == 32) ((uint32_t *)(r + 1))[i] = ((long *)p->data)[i];
+            else if (p->format == 16) ((uint16_t *)(r + 1))[i] = ((short *)p->data)[i];
+            else ((uint8_t *)(r + 1))[i] = p->data[i];
+        }
+    }
+    return (xcb_get_property_cookie_t){ fakecookie(r) };
+}
+
+xcb_get_property_reply_t *xcb_get_property_reply(xcb_connection_t *c, xcb_get_property_cookie_t cookie,
+                                                 xcb_generic_error_t **e) {
+    return fakereply(cookie.sequence);
+}
+
+void *xcb_get_property_value(const xcb_get_property_reply_t *r) {
+    return (void *)(r + 1);
+}
+
+int xcb_get_property_value_length(const xcb_get_property_reply_t *r) {
+    return r->value_len * (r->format/8);
+}
+
+xcb_get_window_attributes_cookie_t xcb_get_window_attributes(xcb_connection_t *c, xcb_window_t window) {
+    FakeWin *f = fakewin(window);
+    xcb_get_window_attributes_reply_t *r = f ? calloc(1, sizeof(*r)):NULL;
+    if (r) {
+        r->map_state = f->mapped ? XCB_MAP_STATE_VIEWABLE:XCB_MAP_STATE_UNMAPPED;
+        r->override_redirect = f->override;
+    }
+    return (xcb_get_window_attributes_cookie_t){ fakecookie(r) };
+}
+
+xcb_get_window_attributes_reply_t *xcb_get_window_attributes_reply(xcb_connection_t *c,
+        xcb_get_window_attributes_cookie_t cookie, xcb_generic_error_t **e) {
+    return fakereply(cookie.sequence);
+}
+
+xcb_get_geometry_cookie_t xcb_get_geometry(xcb_connection_t *c, xcb_drawable_t drawable) {
+    FakeWin *f = fakewin(drawable);
+    xcb_get_geometry_reply_t *r = f ? calloc(1, sizeof(*r)):NULL;
+    if (r) { r->root = FAKEROOT; r->x = f->x; r->y = f->y; r->width = f->w; r->height = f->h; r->border_width = f->bw; }
+    return (xcb_get_geometry_cookie_t){ fakecookie(r) };
+}
+
+xcb_get_geometry_reply_t *xcb_get_geometry_reply(xcb_connection_t *c, xcb_get_geometry_cookie_t cookie,
+                                                 xcb_generic_error_t **e) {
+    return fakereply(cookie.sequence);
+}
@@ -0,0 +1,57 @@
+/* see LICENSE for copyright and license
+ *
+ * runs ipcload against the command socket of the wm on a fake display
+ * (see fakex.h), which handles its commands and queries in its event
+ * loop until ipcload tells it to quit, and with "bench" loads it with
+ * more lines over 1, 4 and 16 connections
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include "fakex.h"
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    const char *base = strrchr(argv[0], '/');
+    const char *runs[][2] = { { "20000", "4" }, { "200000", "1" }, { "200000", "4" }, { "200000", "16" } };
+    char tool[256];
+    unsigned int bad = 0;
+
+    snprintf(tool, sizeof(tool), "%.*sipcload", base ? (int)(base - argv[0] + 1):0, argv[0]);
+    fakemonitors(&(XineramaScreenInfo){ 0, 0, 0, 1920, 1080 }, 1);
+    fakeopen();
+    if (ipcfd < 0) errx(EXIT_FAILURE, "ipc: the wm has no command socket");
+    for (int i = 1; i >= 0; i--) {
+        change_desktop(&(Arg){.i = i});
+        fakemap(fakewindow(0, 0, 640, 480, "client\0Client"));
+        fakebatch();
+    }
+    /* the wm reaps its children, ipcload's status is waited for here */
+    signal(SIGCHLD, SIG_DFL);
+
+    for (unsigned int r = bench ? 1:0; r < (bench ? LENGTH(runs):1); r++) {
+        pid_t pid = fork();
+        int status = 0;
+        if (pid < 0) err(EXIT_FAILURE, "ipc: fork");
+        if (!pid) {
+            dup2(fileno(fakeout), STDOUT_FILENO);
+            execl(tool, tool, "-q", "-n", runs[r][0], "-c", runs[r][1], ipcaddr.sun_path, (char *)NULL);
+            err(127, "ipc: cannot run %s", tool);
+        }
+        alarm(60); /* the default action ends the test if the wm never quits */
+        run();
+        alarm(0);
+        running = True;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "ipc: ipcload with %s lines on %s connections failed\n", runs[r][0], runs[r][1]);
+            bad++;
+        }
+        if (monitors[0].currdeskidx > 1 || !monitors[0].desktops[monitors[0].currdeskidx].curr) {
+            fprintf(stderr, "ipc: desktop %d is shown, without a current window\n", monitors[0].currdeskidx);
+            bad++;
+        }
+    }
+    fakeclose();
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
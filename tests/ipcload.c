@@ -0,0 +1,171 @@
+/* see LICENSE for copyright and license
+ *
+ * ipcload - load the command socket of monsterwm
+ *
+ * sends count lines over several connections at once, alternating
+ * change_desktop commands between the first two desktops and window
+ * queries, without waiting for the replies, and reads the replies as
+ * they come, with at most depth queries in flight on each connection.
+ * reports the lines sent per second and the latency of the queries,
+ * and exits with failure if a reply is wrong or does not come.
+ * with -q the wm is told to quit once all the replies are in.
+ *
+ * usage: ipcload [-q] [-n count] [-c connections] [-d depth] [socket]
+ * the socket defaults to $MONSTERWM_SOCKET
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXCONNS 16
+#define MAXDEPTH 256
+#define TIMEOUT  5000 /* ms to wait for the wm before giving up */
+
+/**
+ * a connection to the socket
+ *
+ * lines   - the number of lines to send on it
+ * queued  - the number of lines written to out so far
+ * queries - the number of queries among them
+ * replies - the number of replies read
+ * out     - the lines not sent yet, from pos to len
+ * in      - the input after the last complete reply
+ * sent    - when each query in flight was queued, a ring indexed by query
+ */
+typedef struct {
+    int fd;
+    unsigned int lines, queued, queries, replies;
+    char out[256], in[256];
+    size_t pos, len, inlen;
+    double sent[MAXDEPTH];
+} Conn;
+
+static Conn conns[MAXCONNS];
+static double *latency;
+static unsigned int nlatency, bad;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * queue the next lines of connection c while there is room
+ * in its output and for more queries in flight
+ */
+static void fill(Conn *c, unsigned int depth) {
+    if (c->pos == c->len) c->pos = c->len = 0;
+    while (c->queued < c->lines && sizeof(c->out) - c->len > 32) {
+        if (c->queued % 2 && c->queries - c->replies >= depth) break;
+        if (c->queued % 2) c->sent[c->queries++ % MAXDEPTH] = now();
+        c->len += sprintf(c->out + c->len, c->queued % 2 ? "window\n":"change_desktop %u\n", c->queued / 2 % 2);
+        c->queued++;
+    }
+}
+
+/**
+ * read the replies available on connection c, each the id
+ * of the current window for the oldest query in flight
+ */
+static int drain(Conn *c) {
+    ssize_t n = read(c->fd, c->in + c->inlen, sizeof(c->in) - 1 - c->inlen);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    if (n <= 0) return -1;
+    c->in[(c->inlen += n)] = '\0';
+
+    char *line = c->in;
+    for (char *nl = NULL; (nl = strchr(line, '\n')); line = nl + 1) {
+        *nl = '\0';
+        if (c->replies == c->queries || strncmp(line, "0x", 2)) {
+            if (bad++ < 10) warnx("unexpected reply: %s", line);
+            continue;
+        }
+        latency[nlatency++] = now() - c->sent[c->replies++ % MAXDEPTH];
+    }
+    memmove(c->in, line, (c->inlen -= line - c->in) + 1);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int count = 10000, nconns = 4, depth = 16, quit = 0;
+    const char *path = getenv("MONSTERWM_SOCKET");
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct pollfd fds[MAXCONNS];
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "qn:c:d:")) != -1) switch (opt) {
+        case 'q': quit = 1; break;
+        case 'n': count = strtoul(optarg, NULL, 10); break;
+        case 'c': nconns = strtoul(optarg, NULL, 10); break;
+        case 'd': depth = strtoul(optarg, NULL, 10); break;
+        default: errx(EXIT_FAILURE, "usage: ipcload [-q] [-n count] [-c connections] [-d depth] [socket]");
+    }
+    if (optind < argc) path = argv[optind];
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) errx(EXIT_FAILURE, "no socket, or its path is too long");
+    if (nconns < 1 || nconns > MAXCONNS) errx(EXIT_FAILURE, "between 1 and %d connections", MAXCONNS);
+    if (depth < 1 || depth > MAXDEPTH) errx(EXIT_FAILURE, "a depth between 1 and %d", MAXDEPTH);
+    if (!(latency = calloc(count / 2 + 1, sizeof(double)))) err(EXIT_FAILURE, "cannot allocate latencies");
+    strcpy(addr.sun_path, path);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (unsigned int i = 0; i < nconns; i++) {
+        Conn *c = &conns[i];
+        if ((c->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)))
+            err(EXIT_FAILURE, "cannot connect to %s", path);
+        fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+        c->lines = count / nconns + (i < count % nconns);
+    }
+
+    double start = now();
+    for (unsigned int done = 0; done < nconns;) {
+        for (unsigned int i = 0; i < nconns; i++) {
+            fill(&conns[i], depth);
+            fds[i] = (struct pollfd){ conns[i].fd, POLLIN | (conns[i].pos < conns[i].len ? POLLOUT:0), 0 };
+        }
+        int n = poll(fds, nconns, TIMEOUT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) err(EXIT_FAILURE, "poll");
+        if (!n) { warnx("timed out waiting for the wm"); bad++; break; }
+        done = 0;
+        for (unsigned int i = 0; i < nconns; i++) {
+            Conn *c = &conns[i];
+            if (fds[i].revents & POLLOUT) {
+                ssize_t w = write(c->fd, c->out + c->pos, c->len - c->pos);
+                if (w < 0 && errno != EAGAIN && errno != EINTR) err(EXIT_FAILURE, "cannot send");
+                if (w > 0) c->pos += w;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR) && drain(c))
+                errx(EXIT_FAILURE, "the wm closed connection %u", i);
+            done += c->queued == c->lines && c->pos == c->len && c->replies == c->queries;
+        }
+    }
+    double elapsed = now() - start;
+
+    if (quit) {
+        fcntl(conns[0].fd, F_SETFL, fcntl(conns[0].fd, F_GETFL) & ~O_NONBLOCK);
+        if (write(conns[0].fd, "quit\n", 5) != 5) warn("cannot send quit");
+    }
+    for (unsigned int i = 0; i < nconns; i++) close(conns[i].fd);
+
+    qsort(latency, nlatency, sizeof(double), cmp);
+    printf("ipcload: %u lines on %u connections in %.3f s, %.0f lines/s, "
+           "query latency median %.1f us 99%% %.1f us, %u bad\n", count, nconns, elapsed, count / elapsed,
+           nlatency ? latency[nlatency / 2] * 1e6:0, nlatency ? latency[nlatency * 99 / 100] * 1e6:0, bad);
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/* see LICENSE for copyright and license
+ *
+ * checks that the cells each layout computes, each a rect grown by the
+ * border it shares with its neighbours, cover the tiled area with no
+ * overlap and no gap, for every layout, number of windows and master
+ * and stack size, and with "bench" times each layout for 1 to 10000
+ * windows
+ *
+ * layouts that leave a window no space, as a spiral of many windows
+ * does, are counted but not failed: their other windows must still be
+ * in the area and not overlap, and the empty windows must start in it
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+
+#define MAXN 64
+
+static const Rect areas[] = { { 0, 0, 1920, 1080 }, { 1366, 18, 1366, 750 }, { 0, 0, 1023, 767 } };
+static const int maszs[] = { -300, -150, 0, 150, 300 }, saszs[] = { -150, -50, 0, 50, 150 };
+
+/**
+ * check the cells of n windows laid out in area a, windows that are
+ * stacked on one another in the same cell count once, count the empty
+ * cells in *empty, and return whether the cells do not tile the area,
+ * the area being only checked to be covered if no cell is empty
+ */
+static Bool check(const Rect *a, const Rect *r, int n, int bw, unsigned int *empty, char *why, size_t size) {
+    Rect c[MAXN];
+    long covered = 0;
+    int k = 0;
+
+    *empty = 0;
+    for (int i = 0; i < n; i++) {
+        Rect e = { r[i].x, r[i].y, r[i].w + bw, r[i].h + bw };
+        int j = 0;
+        while (j < k && memcmp(&c[j], &e, sizeof(e))) j++;
+        if (j < k) continue;
+        if (e.w < 1 || e.h < 1) {
+            if (e.x < a->x || e.y < a->y || e.x > a->x + a->w - bw || e.y > a->y + a->h - bw) {
+                snprintf(why, size, "empty window %d at %d,%d is outside the area", i, e.x, e.y);
+                return True;
+            }
+            (*empty)++;
+            continue;
+        }
+        if (e.x < a->x || e.y < a->y || e.x + e.w > a->x + a->w - bw || e.y + e.h > a->y + a->h - bw) {
+            snprintf(why, size, "window %d at %d,%d %dx%d is outside the area", i, e.x, e.y, e.w, e.h);
+            return True;
+        }
+        for (j = 0; j < k; j++) if (e.x < c[j].x + c[j].w && c[j].x < e.x + e.w && e.y < c[j].y + c[j].h && c[j].y < e.y + e.h) {
+            snprintf(why, size, "window %d at %d,%d %dx%d overlaps a window at %d,%d %dx%d",
+                     i, e.x, e.y, e.w, e.h, c[j].x, c[j].y, c[j].w, c[j].h);
+            return True;
+        }
+        covered += (long)e.w * e.h;
+        c[k++] = e;
+    }
+    if (*empty || covered == (long)(a->w - bw) * (a->h - bw)) return False;
+    snprintf(why, size, "%ld of %ld pixels are covered", covered, (long)(a->w - bw) * (a->h - bw));
+    return True;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    static Rect r[10000];
+    unsigned int bad = 0, runs = 0, empty = 0, cells = 0;
+    char why[128];
+
+    for (int mode = 0; mode < MODES; mode++) if (layout[mode]) for (int n = 1; n <= MAXN; n++)
+    for (unsigned int ia = 0; ia < LENGTH(areas); ia++) for (unsigned int im = 0; im < LENGTH(maszs); im++)
+    for (unsigned int is = 0; is < LENGTH(saszs); is++) {
+        const Rect *a = &areas[ia];
+        Desktop d = { .mode = mode, .masz = maszs[im], .sasz = saszs[is] };
+        int msz = (mode == BSTACK ? a->h:a->w) * MASTER_SIZE + d.masz;
+        if (msz < MINWSZ || (mode == BSTACK ? a->h:a->w) - msz < MINWSZ) continue; /* see resize_master */
+
+        layout[mode](a->x, a->y, a->w, a->h, &d, n, r);
+        unsigned int e = 0;
+        const Bool wrong = check(a, r, n, mode == MONOCLE ? 0:BORDER_WIDTH, &e, why, sizeof(why));
+        runs++;
+        empty += e > 0; cells += e;
+        if (wrong && bad++ < 10) fprintf(stderr, "layouts: mode %d, %d windows in %dx%d, masz %d sasz %d: %s\n",
+                                               mode, n, a->w, a->h, d.masz, d.sasz, why);
+    }
+    printf("layouts: %u layouts, %u with %u empty windows not checked to cover the area, %u not tiled\n",
+           runs, empty, cells, bad);
+
+    if (bench) for (int mode = 0; mode < MODES; mode++) if (layout[mode]) {
+        printf("layouts: mode %d", mode);
+        for (int n = 1; n <= 10000; n *= 10) {
+            unsigned int calls = 0;
+            double t0 = now();
+            for (unsigned int im = 0; im < LENGTH(maszs); im++) for (unsigned int is = 0; is < LENGTH(saszs); is++)
+                for (int k = 0; k < 100000/n + 1; k++, calls++) {
+                    Desktop d = { .mode = mode, .masz = maszs[im], .sasz = saszs[is] };
+                    layout[mode](0, 0, 1920, 1080, &d, n, r);
+                }
+            printf(", %d windows %.0f ns", n, (now() - t0) * 1e9 / calls);
+        }
+        printf(" per layout (%d)\n", r[0].w % 2);
+    }
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/* see LICENSE for copyright and license
+ *
+ * checks that the monitors follow the outputs, with the wm on a fake
+ * display (see fakex.h), on random sequences of outputs added, removed,
+ * moved and resized, many of them keeping the size of the root window,
+ * and of windows mapped and desktops switched in between. after each
+ * change the windows of the shown desktops must be tiled in their
+ * monitor and all others hidden. with "bench" times an output change
+ * with 10, 100 and 1000 windows on each monitor
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include "fakex.h"
+
+#define MAXN 1000
+
+static const struct { int n; XineramaScreenInfo s[3]; } outputs[] = {
+    { 2, { { 0, 0, 0, 1920, 1080 }, { 1, 1920, 0, 1920, 1080 } } },
+    { 2, { { 0, 1920, 0, 1920, 1080 }, { 1, 0, 0, 1920, 1080 } } },    /* swapped */
+    { 2, { { 0, 0, 0, 1280, 1024 }, { 1, 1920, 0, 1920, 1080 } } },    /* smaller */
+    { 2, { { 0, 0, 56, 1920, 1024 }, { 1, 1920, 0, 1920, 1080 } } },   /* moved down */
+    { 2, { { 0, 1920, 0, 1920, 1080 }, { 1, 0, 0, 1280, 1024 } } },    /* swapped, smaller */
+    { 1, { { 0, 0, 0, 1920, 1080 } } },
+    { 2, { { 0, 0, 0, 1920, 1080 }, { 1, 0, 1080, 1920, 1080 } } },    /* stacked */
+    { 3, { { 0, 0, 0, 1920, 1080 }, { 1, 1920, 0, 1920, 1080 }, { 2, 3840, 0, 1280, 1024 } } },
+};
+
+/**
+ * whether the rect of window f overlaps monitor m
+ */
+static Bool overlaps(const FakeWin *f, const Monitor *m) {
+    return f->x < m->x + m->w && f->x + f->w > m->x && f->y < m->y + m->h && f->y + f->h > m->y;
+}
+
+/**
+ * check the monitors against the outputs, and that the clients of
+ * each monitor's current desktop are tiled in it and all others hidden
+ */
+static Bool placed(int o, char *why, size_t size) {
+    if (nmonitors != outputs[o].n) { snprintf(why, size, "%d monitors, not %d", nmonitors, outputs[o].n); return False; }
+    for (int cm = 0; cm < nmonitors; cm++) {
+        const Monitor *m = &monitors[cm];
+        const XineramaScreenInfo *s = &outputs[o].s[cm];
+        if (m->x != s->x_org || m->y != s->y_org || m->w != s->width || m->h != s->height) {
+            snprintf(why, size, "monitor %d is %dx%d+%d+%d, not %dx%d+%d+%d", cm,
+                     m->w, m->h, m->x, m->y, s->width, s->height, s->x_org, s->y_org);
+            return False;
+        }
+        for (int cd = 0; cd < DESKTOPS; cd++) for (const Client *c = m->desktops[cd].head; c; c = c->next) {
+            const FakeWin *f = &fakewins[c->win];
+            Bool shown = False;
+            for (int i = 0; i < nmonitors; i++) shown |= f->mapped && overlaps(f, &monitors[i]);
+            if (cd != m->currdeskidx && shown)
+                snprintf(why, size, "window 0x%lx of hidden desktop %d of monitor %d is shown", c->win, cd, cm);
+            else if (cd == m->currdeskidx && (!f->mapped || f->x < m->x || f->y < m->y
+                                          || f->x + f->w > m->x + m->w || f->y + f->h > m->y + m->h))
+                snprintf(why, size, "window 0x%lx at %dx%d+%d+%d is not in monitor %d", c->win, f->w, f->h, f->x, f->y, cm);
+            else continue;
+            return False;
+        }
+    }
+    return True;
+}
+
+/**
+ * map n windows on the current desktop of monitor cm, a few at a time
+ * as each one retiles the desktop
+ */
+static void addclients(int cm, int n) {
+    change_monitor(&(Arg){.i = cm});
+    for (int i = 0; i < n; i++) {
+        fakemap(fakewindow(0, 0, 640, 480, "client\0Client"));
+        if (i % 10 == 9 || i == n - 1) fakebatch();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    unsigned int runs = 0, bad = 0, same = 0, o = 0;
+    char why[160];
+
+    fakemonitors(outputs[0].s, outputs[0].n);
+    fakeopen();
+    srand(1);
+    for (int k = 0; k < 5000 && bad < 10; k++) {
+        int r = rand() % 100, total = 0;
+        for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++) total += monitors[cm].desktops[cd].count;
+        if (r < 15 && total < 200) addclients(rand() % nmonitors, 1 + rand() % 4);
+        else if (r < 30) { change_desktop(&(Arg){.i = rand() % 3}); fakebatch(); }
+        else {
+            const int w = fakewins[FAKEROOT].w, h = fakewins[FAKEROOT].h;
+            o = rand() % LENGTH(outputs);
+            fakemonitors(outputs[o].s, outputs[o].n);
+            same += w == fakewins[FAKEROOT].w && h == fakewins[FAKEROOT].h;
+            runs++;
+            fakebatch();
+        }
+        if (!placed(o, why, sizeof(why))) { fprintf(stderr, "monitors: after %u output changes: %s\n", runs, why); bad++; }
+    }
+    fprintf(fakeout, "monitors: %u output changes, %u keeping the root size, %u wrong\n", runs, same, bad);
+
+    for (int n = 10; bench && n <= MAXN; n *= 10) {
+        for (int cm = 0; cm < nmonitors; cm++) for (int cd = 0; cd < DESKTOPS; cd++)
+            while (monitors[cm].desktops[cd].head) fakedestroy(monitors[cm].desktops[cd].head->win), fakebatch();
+        o = 0;
+        fakemonitors(outputs[o].s, outputs[o].n); fakebatch();
+        for (int cm = 0; cm < 2; cm++) addclients(cm, n);
+
+        /* the outputs swap places, which leaves the root window as it was */
+        const int calls = 10000/n + 10;
+        unsigned long reqs = 0, trips = 0;
+        double t = 0;
+        for (int k = 0; k < calls; k++) {
+            unsigned long r0 = fakereqs, t0 = faketrips;
+            double s = now();
+            o = !o;
+            fakemonitors(outputs[o].s, outputs[o].n); fakebatch();
+            t += now() - s;
+            reqs += fakereqs - r0; trips += faketrips - t0;
+        }
+        if (!placed(o, why, sizeof(why))) { fprintf(stderr, "monitors: after %d output changes: %s\n", calls, why); bad++; }
+        fprintf(fakeout, "monitors: %4d windows on each monitor, output change %.1f us, %.1f requests, %.1f round trips\n",
+                n, t * 1e6 / calls, (double)reqs / calls, (double)trips / calls);
+    }
+    fakeclose();
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
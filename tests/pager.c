@@ -0,0 +1,133 @@
+/* see LICENSE for copyright and license
+ *
+ * feeds the pager of monsterstatus lines of desktop information through
+ * a pipe, in chunks of random sizes that split and join lines, and checks
+ * that after each read the desktops show the newest whole line that fit
+ * in the pager buffer. lines carry malformed entries, numbers too long
+ * for an int among them, and entries of other monitors and desktops,
+ * which are to be ignored, and some are too long for the buffer, or
+ * exactly as long as it holds. with "bench" more lines
+ * are fed and the pager is timed.
+ */
+
+#define main monsterstatus
+#include "3rdparty/monsterstatus.c"
+#undef main
+
+#define MAXDESKS 8
+
+typedef struct {
+    int windows[MAXDESKS], current[MAXDESKS], urgent[MAXDESKS], mode;
+} state_t;
+
+static char stream[1 << 17];
+static size_t head, tail, base; /* pending bytes, and the offset of stream[0] in what was written */
+static struct { size_t end; state_t s; } queue[1024]; /* lines that fit, by the offset of their end */
+static unsigned int qhead, qtail;
+
+/**
+ * append a run of digits too long for an int, one that would wrap
+ * around to n, or a random one of up to a hundred digits
+ */
+static size_t longnumber(char *s, size_t size, int n) {
+    size_t len = 0;
+    if (rand() % 2) return snprintf(s, size, "%llu", (1ULL << 32) * (1 + rand() % 4) + n);
+    for (size_t k = 11 + rand() % 90; len < k && len < size - 1; len++) s[len] = '0' + (len ? rand() % 10:1 + rand() % 9);
+    s[len] = '\0';
+    return len;
+}
+
+/**
+ * append a line for monitor 0 with desks desktops to the stream, and
+ * queue the state it sets if it fits in the pager buffer
+ */
+static void randline(int desks) {
+    char *s = stream + tail;
+    size_t len = 0, size = sizeof(stream) - tail - 1;
+    int kind = rand() % 100, cur = rand() % desks;
+    state_t st = { .mode = rand() % (int)(sizeof(layout)/sizeof(layout[0]) - 1) }; /* every named mode id */
+    /* one in a hundred lines is as long as the buffer holds, one past
+     * it or a few buffers long, the longer ones are marked to be dropped */
+    size_t want = kind == 0 ? PAGER_BUFFER - 1:kind == 1 ? PAGER_BUFFER:kind == 2 ? (size_t)(PAGER_BUFFER + rand() % (3*PAGER_BUFFER)):0;
+
+    for (int d = 0; d < desks; d++) {
+        st.windows[d] = want < PAGER_BUFFER ? rand() % 30:99;
+        st.current[d] = d == cur; st.urgent[d] = d != cur && !(rand() % 4);
+    }
+    for (int m = 0; m < 2; m++) for (int d = 0; d <= desks; d++) {
+        if (!(rand() % 8)) len += snprintf(s + len, size - len, "%d:0:%d:1x:0:1:0 ", m, d % desks);
+        if (!(rand() % 8)) len += snprintf(s + len, size - len, "%d:0:%d:1:2:3:4:5 ", m, d % desks);
+        if (!(rand() % 8)) {
+            const int f = rand() % 7; /* the field that is too long */
+            for (int k = 0; k < 7; k++) {
+                if (k == f) len += longnumber(s + len, size - len, k == 2 ? d % desks:k == 5);
+                else len += snprintf(s + len, size - len, "%d", k == 2 ? d % desks:k == 3 ? 99:k == 5);
+                len += snprintf(s + len, size - len, k < 6 ? ":":" ");
+            }
+        }
+        if (m || d == desks) len += snprintf(s + len, size - len, "%d:0:%d:%d:%d:1:1 ", m, d, rand() % 30, rand() % 5);
+        else len += snprintf(s + len, size - len, "%d:0:%d:%d:%d:%d:%d ", m, d, st.windows[d], st.mode, st.current[d], st.urgent[d]);
+    }
+    /* pad with spaces before the entries, as empty entries, so that what
+     * is left of a dropped line would show if the pager did not skip it */
+    if (want > len) {
+        memmove(s + want - len, s, len);
+        memset(s, ' ', want - len);
+        len = want;
+    }
+    s[len++] = '\n';
+    tail += len;
+
+    if (len > PAGER_BUFFER) return;
+    queue[qtail % LENGTH(queue)].end = base + tail;
+    queue[qtail++ % LENGTH(queue)].s = st;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const int bench = argc > 1 && !strcmp(argv[1], "bench");
+    const unsigned long lines = bench ? 10000000:1000000;
+    unsigned long made = 0, reads = 0, bad = 0, parsed = 0;
+    state_t expect = { .mode = 0 };
+    int fds[2], desks = 0;
+    double spent = 0;
+
+    while (desktop[desks].n) desks++;
+    if (desks > MAXDESKS || pipe(fds) || fcntl(fds[0], F_SETFL, O_NONBLOCK)) return EXIT_FAILURE;
+    srand(1);
+
+    while (made < lines || head < tail) {
+        if (tail > sizeof(stream) / 2) { /* keep room for the longest line */
+            memmove(stream, stream + head, tail - head);
+            base += head; tail -= head; head = 0;
+        }
+        while (made < lines && tail - head < sizeof(stream) / 4 && qtail - qhead < LENGTH(queue)) { randline(desks); made++; }
+
+        size_t n = 1 + rand() % 8192;
+        if (n > tail - head) n = tail - head;
+        if (write(fds[1], stream + head, n) != (ssize_t)n) return EXIT_FAILURE;
+        head += n;
+
+        double t0 = now();
+        monsterpager(fds[0], 0, desks);
+        spent += now() - t0;
+        reads++;
+
+        while (qhead != qtail && queue[qhead % LENGTH(queue)].end <= base + head) {
+            expect = queue[qhead++ % LENGTH(queue)].s;
+            parsed++;
+        }
+        int ok = mode == expect.mode;
+        for (int d = 0; d < desks; d++) ok &= desktop[d].windows == expect.windows[d] && desktop[d].current == expect.current[d]
+                                          && desktop[d].urgent == expect.urgent[d];
+        if (!ok && bad++ < 10) fprintf(stderr, "pager: read %lu at byte %lu does not show the newest line\n", reads, base + head);
+    }
+    printf("pager: %lu lines in %lu reads, %lu fit, %lu wrong\n", made, reads, parsed, bad);
+    if (bench) printf("pager: %.1f MB/s, %.0f ns per line\n", (base + head) / spent / 1e6, spent * 1e9 / made);
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/* see LICENSE for copyright and license
+ *
+ * replays the event log of a profile build of monsterwm (see proflog)
+ * on the display monsterwm manages, doing what caused each event:
+ * windows are created with their recorded geometry, names and transient
+ * and mapped, configured, unmapped and destroyed, keys and buttons are
+ * pressed with the xtest extension, the pointer is moved into windows
+ * and client messages and property changes are sent. events the wm
+ * caused itself, as the unmaps of hidden windows, are not replayed.
+ *
+ * after each event the display is synced, and with -s the wm is asked
+ * twice for the current window on its command socket, which it answers
+ * only after it handled the events it had been sent. with -q the wm is
+ * told to quit once the log is replayed.
+ *
+ * usage: replay [-q] [-s socket] log
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XTest.h>
+
+#define LENGTH(x) (sizeof(x)/sizeof(*x))
+
+static Display *dis;
+static Window root;
+static Bool xtest;
+static int sock = -1;
+static XModifierKeymap *modmap;
+static struct { unsigned long id; Window win; } wins[4096];
+static unsigned int nwins;
+
+/**
+ * the window created for a recorded window id, None if there is none
+ */
+static Window lookup(unsigned long id) {
+    for (unsigned int i = 0; i < nwins; i++) if (wins[i].id == id) return wins[i].win;
+    return None;
+}
+
+/**
+ * an atom by name, where None and numbers are taken as they are
+ */
+static Atom atom(const char *name) {
+    char *end = NULL;
+    long n = strtol(name, &end, 10);
+    return !strcmp(name, "None") ? None:*end ? XInternAtom(dis, name, False):(Atom)n;
+}
+
+/**
+ * press or release the modifier keys of a key or button state
+ */
+static void modifiers(unsigned int state, Bool press) {
+    for (int i = 0; i < 8; i++) if (state & (1 << i)) for (int k = 0; k < modmap->max_keypermod; k++) {
+        KeyCode code = modmap->modifiermap[i * modmap->max_keypermod + k];
+        if (code) { XTestFakeKeyEvent(dis, code, press, CurrentTime); break; }
+    }
+}
+
+/**
+ * move the pointer into a window, unless it already is there
+ */
+static void enter(Window w) {
+    Window r, child; int rx, ry, x, y; unsigned int mask, width, height, bw, depth;
+    if (XQueryPointer(dis, root, &r, &child, &rx, &ry, &x, &y, &mask) && child == w) return;
+    if (XGetGeometry(dis, w, &r, &x, &y, &width, &height, &bw, &depth))
+        XWarpPointer(dis, None, w, 0, 0, 0, 0, width/2, height/2);
+}
+
+/**
+ * read the reply of the wm to a query on the command socket
+ */
+static void ask(const char *query) {
+    char c = 0;
+    if (sock < 0 || write(sock, query, strlen(query)) < 0) return;
+    while (read(sock, &c, 1) == 1 && c != '\n');
+}
+
+/**
+ * do what caused a logged event, return whether it was replayed
+ */
+static Bool replay(const char *event, char *args) {
+    unsigned long id = 0, other = 0;
+    Window w = None;
+    char name[64], sym[64], sym2[64];
+    int x, y, width, height, bw, detail, kept;
+    unsigned int keycode, button, state;
+    long mask, l0;
+
+    if (!strcmp(event, "maprequest") && sscanf(args, "%lx %d %d %d %d %lx", &id, &x, &y, &width, &height, &other) == 6) {
+        if (!(w = lookup(id))) {
+            if (nwins >= LENGTH(wins)) return False;
+            w = XCreateSimpleWindow(dis, root, x, y, width > 0 ? width:1, height > 0 ? height:1, 0,
+                                    BlackPixel(dis, DefaultScreen(dis)), WhitePixel(dis, DefaultScreen(dis)));
+            wins[nwins].id = id; wins[nwins++].win = w;
+            /* a recorded close is replayed with the destroy that followed it,
+             * and a window without the protocol is killed with its client */
+            Atom del = XInternAtom(dis, "WM_DELETE_WINDOW", False);
+            XSetWMProtocols(dis, w, &del, 1);
+        }
+        char *instance = strchr(args, '\t'), *class = instance ? strchr(++instance, '\t'):NULL,
+             *title = class ? strchr(++class, '\t'):NULL;
+        if (title) {
+            *(class - 1) = *title++ = '\0';
+            title[strcspn(title, "\n")] = '\0';
+            XClassHint ch = { instance, class };
+            XSetClassHint(dis, w, &ch);
+            XStoreName(dis, w, title);
+        }
+        if (other && lookup(other)) XSetTransientForHint(dis, w, lookup(other));
+        XMapWindow(dis, w);
+    } else if (!strcmp(event, "configurerequest")
+            && sscanf(args, "%lx %d %d %d %d %ld %d %d", &id, &x, &y, &width, &height, &mask, &bw, &detail) == 8) {
+        XWindowChanges wc = { .x = x, .y = y, .width = width, .height = height, .border_width = bw, .stack_mode = detail };
+        if (!(w = lookup(id))) return False;
+        XConfigureWindow(dis, w, mask & ~CWSibling, &wc);
+    } else if (!strcmp(event, "unmapnotify") && sscanf(args, "%lx %d %d", &id, &detail, &kept) == 3) {
+        if (kept || !(w = lookup(id))) return False;
+        if (!detail) XUnmapWindow(dis, w);
+        else {
+            XEvent ev = { .xunmap = { .type = UnmapNotify, .event = root, .window = w } };
+            XSendEvent(dis, root, False, SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+        }
+    } else if (!strcmp(event, "destroynotify") && sscanf(args, "%lx", &id) == 1) {
+        if (!(w = lookup(id))) return False;
+        XDestroyWindow(dis, w);
+        for (unsigned int i = 0; i < nwins; i++) if (wins[i].id == id) wins[i] = wins[--nwins];
+    } else if (!strcmp(event, "enternotify") && sscanf(args, "%lx %d", &id, &detail) == 2) {
+        if (detail != NotifyNormal || !(w = lookup(id))) return False;
+        enter(w);
+    } else if (!strcmp(event, "keypress") && sscanf(args, "%lx %u %u %63s", &id, &keycode, &state, sym) == 4) {
+        KeySym ks = XStringToKeysym(sym);
+        KeyCode code = ks != NoSymbol ? XKeysymToKeycode(dis, ks):0;
+        if (!xtest || !(code = code ? code:keycode)) return False;
+        modifiers(state, True);
+        XTestFakeKeyEvent(dis, code, True, CurrentTime);
+        XTestFakeKeyEvent(dis, code, False, CurrentTime);
+        modifiers(state, False);
+    } else if (!strcmp(event, "buttonpress") && sscanf(args, "%lx %u %u", &id, &button, &state) == 3) {
+        if (!xtest) return False;
+        if ((w = lookup(id))) enter(w);
+        modifiers(state, True);
+        XTestFakeButtonEvent(dis, button, True, CurrentTime);
+        XTestFakeButtonEvent(dis, button, False, CurrentTime);
+        modifiers(state, False);
+    } else if (!strcmp(event, "propertynotify") && sscanf(args, "%lx %63s %d", &id, name, &kept) == 3) {
+        Atom a = atom(name), type = None;
+        int format = 0; unsigned long n = 0, after = 0; unsigned char *data = NULL;
+        if (!(w = lookup(id)) || a == None) return False;
+        if (a == XA_WM_HINTS) {
+            XWMHints wmh = { .flags = kept ? XUrgencyHint:0 };
+            XSetWMHints(dis, w, &wmh);
+        } else if (XGetWindowProperty(dis, w, a, 0, 0, False, AnyPropertyType, &type, &format, &n, &after, &data) == Success) {
+            /* appending nothing notifies the change and keeps the value */
+            XChangeProperty(dis, w, a, type ? type:XA_STRING, format ? format:8, PropModeAppend, NULL, 0);
+            if (data) XFree(data);
+        }
+    } else if (!strcmp(event, "clientmessage") && sscanf(args, "%lx %63s %ld %63s %63s", &id, name, &l0, sym, sym2) == 5) {
+        if (!(w = lookup(id))) return False;
+        XEvent ev = { .xclient = { .type = ClientMessage, .window = w, .message_type = atom(name), .format = 32 } };
+        ev.xclient.data.l[0] = l0; ev.xclient.data.l[1] = atom(sym); ev.xclient.data.l[2] = atom(sym2);
+        XSendEvent(dis, root, False, SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+    } else return False;
+    return True;
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    Bool quit = False;
+    int opt, ev, error, major, minor;
+
+    while ((opt = getopt(argc, argv, "qs:")) != -1) {
+        if (opt == 'q') quit = True;
+        else if (opt == 's' && strlen(optarg) < sizeof(sa.sun_path)) strcpy(sa.sun_path, optarg);
+        else { fprintf(stderr, "usage: replay [-q] [-s socket] log\n"); return EXIT_FAILURE; }
+    }
+    FILE *f = optind < argc ? fopen(argv[optind], "r"):NULL;
+    if (!f) { fprintf(stderr, "usage: replay [-q] [-s socket] log\n"); return EXIT_FAILURE; }
+    if (!(dis = XOpenDisplay(NULL))) { fprintf(stderr, "replay: cannot open display\n"); return EXIT_FAILURE; }
+    root = DefaultRootWindow(dis);
+    modmap = XGetModifierMapping(dis);
+    if (!(xtest = XTestQueryExtension(dis, &ev, &error, &major, &minor)))
+        fprintf(stderr, "replay: no xtest extension, keys and buttons are not replayed\n");
+    if (*sa.sun_path && ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(sock, (struct sockaddr *)&sa, sizeof(sa)))) {
+        perror(sa.sun_path);
+        return EXIT_FAILURE;
+    }
+
+    char line[1024], event[32];
+    unsigned int done = 0, skipped = 0;
+    int n;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (fgets(line, sizeof(line), f)) {
+        if ((n = 0) || sscanf(line, "%*d %*u %*u %*u %31s %n", event, &n) < 1 || !n) continue;
+        if (!replay(event, line + n)) { skipped++; continue; }
+        XSync(dis, False);
+        ask("window\n"); ask("window\n");
+        done++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("replay: %u events replayed, %u skipped, in %.1f ms\n", done, skipped,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+    for (unsigned int i = 0; i < nwins; i++) XDestroyWindow(dis, wins[i].win);
+    XSync(dis, False);
+    ask("window\n"); ask("window\n");
+    if (quit && sock >= 0 && write(sock, "quit\n", 5) < 0) perror("replay");
+    if (sock >= 0) close(sock);
+    XFreeModifiermap(modmap);
+    XCloseDisplay(dis);
+    fclose(f);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# replay a recorded session against a profile build of monsterwm on Xvfb,
+# and report the percentiles of the time each kind of event took to
+# handle, with the requests and bytes sent for it, and the profile
+#
+# a session is recorded by running a profile build with MONSTERWM_EVENTLOG
+# set to a file, see tests/replay.c for what is replayed of it
+#
+# usage: tests/replay.sh session
+
+[ $# -eq 1 ] && [ -r "$1" ] || { echo "usage: tests/replay.sh session, a readable event log" >&2; exit 1; }
+session=$1
+wm=tests/monsterwm-profile
+
+command -v Xvfb >/dev/null || { echo "replay: Xvfb not found, nothing was replayed" >&2; exit 1; }
+[ -x "$wm" ] && [ -x tests/replay ] || { echo "replay: build $wm and tests/replay first" >&2; exit 1; }
+dir=$(mktemp -d) || exit 1
+trap 'kill $wmpid $xpid 2>/dev/null; rm -rf "$dir"' EXIT
+
+Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp 3>"$dir/display" 2>/dev/null &
+xpid=$!
+for i in $(seq 50); do [ -s "$dir/display" ] && break; sleep 0.1; done
+[ -s "$dir/display" ] || { echo "replay: Xvfb did not start" >&2; exit 1; }
+export DISPLAY=:$(cat "$dir/display")
+
+XDG_RUNTIME_DIR=$dir MONSTERWM_EVENTLOG=$dir/events "$wm" 2>"$dir/profile" &
+wmpid=$!
+sock=
+for i in $(seq 50); do
+    for s in "$dir"/*; do [ -S "$s" ] && sock=$s; done
+    [ -n "$sock" ] && break
+    sleep 0.1
+done
+
+if [ -n "$sock" ]; then
+    tests/replay -q -s "$sock" "$session" || exit 1
+else
+    echo "replay: no command socket, the replay is not synced with the wm" >&2
+    sleep 1
+    tests/replay "$session" || exit 1
+    sleep 1
+    kill -USR1 $wmpid; sleep 1; kill $wmpid
+fi
+wait $wmpid
+wmpid=
+
+# the fields of the event log are the time, the microseconds spent,
+# the requests and the bytes sent, and the name of the event
+sort -k5,5 -k2,2n "$dir/events" | awk '
+    function report() {
+        if (n) printf "replay: %-18s %6d events, p50 %5d p90 %5d p99 %5d max %6d us, %7d requests %9d bytes\n",
+                      name, n, us[int((n - 1) * 0.5) + 1], us[int((n - 1) * 0.9) + 1],
+                      us[int((n - 1) * 0.99) + 1], us[n], reqs, bytes
+    }
+    $5 != name { report(); name = $5; n = reqs = bytes = 0 }
+    { us[++n] = $2; reqs += $3; bytes += $4; treqs += $3; tbytes += $4 }
+    END { report(); printf "replay: %d requests and %d bytes sent for the events\n", treqs, tbytes }'
+grep '^profile:' "$dir/profile"
@@ -0,0 +1,138 @@
+/* see LICENSE for copyright and license
+ *
+ * restarts the wm on a fake display (see fakex.h) with 10 and 100
+ * windows on each of two desktops, and checks that it adopts them in
+ * the same order, with the same current and previous client, mode and
+ * sizes, and has the shown desktop tiled at the end of the first batch.
+ * a saved state with sizes that no longer fit the monitor must have them
+ * reset. with "bench" also 1000 windows, and times the restart, from
+ * opening the display to the desktop tiled, and counts its requests
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include "fakex.h"
+#include <limits.h>
+
+#define MAXN 1000
+
+/**
+ * what a desktop should be like after the restart
+ */
+typedef struct {
+    Window wins[MAXN + 1], curr, prev;
+    int n, mode, masz, sasz;
+    Bool sbar;
+} Saved;
+
+static Saved saved[DESKTOPS];
+
+/**
+ * map n windows on the current desktop, a few at a time
+ * as each one retiles the desktop
+ */
+static void addclients(int n) {
+    for (int i = 0; i < n; i++) {
+        fakemap(fakewindow(0, 0, 640, 480, "client\0Client"));
+        if (i % 10 == 9 || i == n - 1) fakebatch();
+    }
+}
+
+static void save(void) {
+    for (int cd = 0; cd < DESKTOPS; cd++) {
+        const Desktop *d = &monitors[0].desktops[cd];
+        Saved *s = &saved[cd];
+        s->n = 0;
+        for (const Client *c = d->head; c; c = c->next) s->wins[s->n++] = c->win;
+        s->curr = d->curr ? d->curr->win:None; s->prev = d->prev ? d->prev->win:None;
+        s->mode = d->mode; s->masz = d->masz; s->sasz = d->sasz; s->sbar = d->sbar;
+    }
+}
+
+/**
+ * check the desktops against those saved, and that the windows
+ * of the shown desktop are tiled in the monitor and others hidden
+ */
+static Bool restored(char *why, size_t size) {
+    const Monitor *m = &monitors[0];
+    for (int cd = 0; cd < DESKTOPS; cd++) {
+        const Desktop *d = &m->desktops[cd];
+        const Saved *s = &saved[cd];
+        int i = 0;
+        for (const Client *c = d->head; c; c = c->next, i++) {
+            const FakeWin *f = &fakewins[c->win];
+            const Bool shown = f->mapped && f->x < m->x + m->w && f->y < m->y + m->h;
+            if (i >= s->n || c->win != s->wins[i])
+                snprintf(why, size, "desktop %d has window 0x%lx at %d, not 0x%lx", cd, c->win, i, i < s->n ? s->wins[i]:0);
+            else if (cd != m->currdeskidx && shown)
+                snprintf(why, size, "window 0x%lx of hidden desktop %d is shown", c->win, cd);
+            else if (cd == m->currdeskidx && (!shown || f->x < m->x || f->y < m->y
+                                          || f->x + f->w > m->x + m->w || f->y + f->h > m->y + m->h))
+                snprintf(why, size, "window 0x%lx at %dx%d+%d+%d is not tiled", c->win, f->w, f->h, f->x, f->y);
+            else continue;
+            return False;
+        }
+        if (i != s->n) snprintf(why, size, "desktop %d has %d windows, not %d", cd, i, s->n);
+        else if ((d->curr ? d->curr->win:None) != s->curr || (d->prev ? d->prev->win:None) != s->prev)
+            snprintf(why, size, "desktop %d has current 0x%lx and previous 0x%lx, not 0x%lx and 0x%lx", cd,
+                     d->curr ? d->curr->win:None, d->prev ? d->prev->win:None, s->curr, s->prev);
+        else if (d->mode != s->mode || d->masz != s->masz || d->sasz != s->sasz || d->sbar != s->sbar)
+            snprintf(why, size, "desktop %d has mode %d sizes %d %d bar %d, not %d %d %d %d", cd,
+                     d->mode, d->masz, d->sasz, d->sbar, s->mode, s->masz, s->sasz, s->sbar);
+        else continue;
+        return False;
+    }
+    return True;
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    unsigned int runs = 0, bad = 0;
+    char why[160];
+
+    fakemonitors(&(XineramaScreenInfo){ 0, 0, 0, 1920, 1080 }, 1);
+    fakeopen();
+    for (int n = 10; n <= (bench ? MAXN:MAXN / 10); n *= 10, runs++) {
+        Monitor *m = &monitors[0];
+        for (int i = 0; i < DESKTOPS; i++) while (m->desktops[i].head) fakedestroy(m->desktops[i].head->win), fakebatch();
+        for (int i = 1; i >= 0; i--) {
+            change_desktop(&(Arg){.i = i}); fakebatch();
+            addclients(n);
+            Desktop *d = &m->desktops[i];
+            d->mode = i ? BSTACK:TILE;
+            resize_master(&(Arg){.i = i ? -40:60});
+            resize_stack(&(Arg){.i = 20});
+            focus(d->head->next, d, m); /* neither first nor last */
+            focus(d->head->next->next, d, m);
+            fakebatch();
+        }
+        save();
+
+        restart();
+        fakeclose();
+        unsigned long r0 = fakereqs, t0 = faketrips;
+        double s = now();
+        fakeopen(); fakebatch();
+        s = now() - s;
+        if (!restored(why, sizeof(why))) { fprintf(stderr, "restart: %d windows on each desktop: %s\n", n, why); bad++; }
+        if (bench) fprintf(fakeout, "restart: %4d windows on each of 2 desktops, restart to tiled %.1f us, "
+                           "%lu requests, %lu round trips\n", n, s * 1e6, fakereqs - r0, faketrips - t0);
+    }
+
+    /* the monitor shrank, or the state was tampered with */
+    restart();
+    fakeclose();
+    FakeProp *p = fakeprop(&fakewins[FAKEROOT], XInternAtom(NULL, "_MONSTERWM_STATE", False));
+    if (!p || p->n < 3 + 2 + 4 * DESKTOPS) errx(EXIT_FAILURE, "restart: no saved state");
+    long *v = (long *)p->data + 3 + 2;
+    v[1] = LONG_MAX; v[2] = LONG_MIN; v[3] = 5;
+    v[4 + 1] = 2000; v[4 + 2] = 1920;
+    saved[0].masz = saved[0].sasz = saved[1].masz = saved[1].sasz = 0;
+    saved[0].sbar = True;
+    fakeopen(); fakebatch();
+    if (!restored(why, sizeof(why))) { fprintf(stderr, "restart: with sizes out of the monitor: %s\n", why); bad++; }
+    fakeclose();
+    fprintf(fakeout, "restart: %u restarts, %u wrong\n", runs + 1, bad);
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}
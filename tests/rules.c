@@ -0,0 +1,134 @@
+/* see LICENSE for copyright and license
+ *
+ * checks that the compiled app rules match the same rule as
+ * trying each rule in order with strstr, both below and above
+ * AUTOMATON_RULES, on random names built from pieces of the
+ * patterns, for the rules of config.h and for 10, 100 and 1000
+ * random rules, and with "bench" times both ways for each
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+
+#define MAXRULES 1000
+
+static const char *prefixes[RULE_PROPS] = { [RULE_CLASS] = "", [RULE_ROLE] = "role:", [RULE_TITLE] = "title:" };
+static AppRule generated[MAXRULES];
+static char patterns_[MAXRULES][32];
+
+/**
+ * the first of the n rules r before rule limit whose pattern
+ * for property p is in s, the slow way
+ */
+static unsigned int naive(const AppRule *r, unsigned int n, int p, const char *s, unsigned int limit) {
+    for (unsigned int i = 0; i < n && i < limit; i++) {
+        int q = RULE_PROPS - 1;
+        while (q > RULE_CLASS && strncmp(r[i].class, prefixes[q], strlen(prefixes[q]))) q--;
+        if (q == p && strstr(s, r[i].class + strlen(prefixes[q]))) return i;
+    }
+    return n < limit ? n:limit;
+}
+
+/**
+ * fill s with random bytes and pieces of the n patterns r, some cut short
+ */
+static void randname(const AppRule *r, unsigned int n, char *s, size_t size) {
+    size_t len = 0, max = 1 + rand() % (size - 1);
+    while (len < max) {
+        if (rand() % 3) { s[len++] = "abcdeMPlyr2:- "[rand() % 14]; continue; }
+        const char *pat = r[rand() % n].class;
+        size_t k = strlen(pat) - rand() % 2 * (rand() % (strlen(pat) + 1));
+        for (size_t i = 0; i < k && len < max; i++) s[len++] = pat[i];
+    }
+    s[len] = '\0';
+}
+
+/**
+ * fill generated with n random rules of 2 to 12 bytes,
+ * a fifth of them matching the role and a fifth the title
+ */
+static void randrules(unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        const char *prefix = prefixes[rand() % 5 < 3 ? RULE_CLASS:rand() % 2 ? RULE_ROLE:RULE_TITLE];
+        size_t len = strlen(prefix), max = len + 2 + rand() % 11;
+        strcpy(patterns_[i], prefix);
+        while (len < max) patterns_[i][len++] = "abcdeMPlyr2:- "[rand() % 14];
+        patterns_[i][len] = '\0';
+        memcpy(&generated[i], &(AppRule){ .class = patterns_[i] }, sizeof(AppRule));
+    }
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * check both ways of matching the n rules r on runs random names,
+ * the last nnames of them kept for the bench, trying the rules one
+ * by one while states is NULL
+ */
+static unsigned int check(const AppRule *r, unsigned int n, unsigned int runs, char names[][257], unsigned int nnames) {
+    unsigned int bad = 0;
+    State *automaton = NULL;
+    compilerules(r, n);
+    compileautomaton();
+    automaton = states;
+    for (unsigned int i = 0; i < runs; i++) {
+        char *s = names[i % nnames];
+        const unsigned int limit = rand() % 4 ? n:rand() % (n + 1);
+        randname(r, n, s, sizeof(names[0]));
+        for (int way = 0; way < 2; way++) {
+            states = way ? automaton:NULL;
+            for (int p = 0; p < RULE_PROPS; p++) if (matchrule(p, s, limit) != naive(r, n, p, s, limit)) {
+                if (bad++ < 10) fprintf(stderr, "rules: %u rules, %s: property %d of \"%s\" matched rule %u, not %u\n",
+                                        n, way ? "automaton":"one by one", p, s, matchrule(p, s, limit), naive(r, n, p, s, limit));
+            }
+        }
+    }
+    states = automaton;
+    return bad;
+}
+
+int main(int argc, char *argv[]) {
+    const Bool bench = argc > 1 && !strcmp(argv[1], "bench");
+    static char names[1024][257];
+    unsigned int bad = 0, sum = 0, total = 0;
+
+    srand(1);
+    for (unsigned int n = 0; n <= MAXRULES; n = n ? n * 10:10) {
+        const AppRule *r = n ? generated:rules;
+        const unsigned int size = n ? n:LENGTH(rules), runs = (bench ? 200000:20000) * 10 / size;
+        if (n) randrules(n);
+        bad += check(r, size, runs, names, runs < LENGTH(names) ? runs:LENGTH(names));
+        total += runs;
+        if (!bench) continue;
+
+        /* most windows match no rule, and their class or title is short */
+        const unsigned int calls = runs < 100000 ? 100000:runs, nnames = runs < LENGTH(names) ? runs:LENGTH(names);
+        static char plain[LENGTH(names)][33];
+        for (unsigned int i = 0; i < LENGTH(plain); i++) {
+            size_t len = 4 + rand() % 28;
+            for (size_t k = 0; k < len; k++) plain[i][k] = "fghijkmnoqstuvwxz"[rand() % 17];
+            plain[i][len] = '\0';
+        }
+        State *automaton = states;
+        double t[4];
+        for (int way = 0; way < 4; way++) {
+            states = way % 2 ? automaton:NULL;
+            double t0 = now();
+            if (way < 2) for (unsigned int i = 0; i < calls; i++) sum += matchrule(RULE_CLASS, names[i % nnames], size);
+            else for (unsigned int i = 0; i < calls; i++) sum += matchrule(RULE_CLASS, plain[i % LENGTH(plain)], size);
+            t[way] = (now() - t0) * 1e9 / calls;
+        }
+        states = automaton;
+        printf("rules: %4u rules%s, one by one %.1f ns automaton %.1f ns per name, "
+               "%.1f ns and %.1f ns per short name matching none (%u)\n",
+               size, n ? "":" of config.h", t[0], t[1], t[2], t[3], sum % 2);
+    }
+    compilerules(rules, LENGTH(rules));
+    printf("rules: %u names, %u mismatches\n", total, bad);
+    return bad ? EXIT_FAILURE:EXIT_SUCCESS;
+}